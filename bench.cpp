@@ -0,0 +1,306 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "train_gru.h"
+
+using namespace gaii;
+
+// benchmark suite, results as JSON on stdout so runs can be diffed
+//
+//   bench [filter]
+//
+// only benchmarks whose name contains filter are run. each result is the best
+// of 5 runs of about 20ms, as ns per iteration and a rate in its own unit
+
+
+volatile float sink;
+
+template<class F>
+double time_ns(F && f)
+{
+    auto run = [&] (long iters) {
+        auto t0 = std::chrono::steady_clock::now();
+        for(long i=0 ; i<iters ; i++) { f(); }
+        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+        return dt.count();
+    };
+    long iters = 1;
+    double t = run(iters);
+    while(t < 2e7 && iters < (1L << 30)) { iters *= 2; t = run(iters); }
+
+    double best = t / iters;
+    for(int r=1 ; r<5 ; r++) { best = std::min(best, run(iters) / iters); }
+    return best;
+}
+
+struct json_report
+{
+    std::ostream & out;
+    std::string filter;
+    int count = 0;
+
+    json_report(std::ostream & out, std::string filter)
+    :   out(out), filter(std::move(filter))
+    {
+        out << "{\n  \"config\": {"
+            << "\"simd_width\": " << simd<float>::W
+            << ", \"math_level\": " << int(default_math_level)
+            << ", \"heap_tensor_bytes\": " << GAII_HEAP_TENSOR_BYTES
+            << "},\n  \"results\": [";
+    }
+    ~json_report() { out << "\n  ]\n}" << std::endl; }
+
+    bool wants(std::string const& name) const
+    {
+        return name.find(filter) != std::string::npos;
+    }
+
+    // ops is the work per iteration, reported per second in unit
+    void add(std::string const& name, double ns, double ops, char const* unit)
+    {
+        out << (count++ ? "," : "") << "\n    {"
+            << "\"name\": \"" << name << "\", "
+            << "\"ns\": " << ns << ", "
+            << "\"rate\": " << ops / ns * 1e9 << ", "
+            << "\"unit\": \"" << unit << "\"}" << std::flush;
+    }
+
+    template<class F>
+    void run(std::string const& name, double ops, char const* unit, F && f)
+    {
+        if(wants(name)) { add(name, time_ns(f), ops, unit); }
+    }
+};
+
+template<class T>
+void randomize(T & t, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> dist {-1, 1};
+    t.apply([&] (auto & v) { v = dist(rng); });
+}
+
+
+template<class T> constexpr char const* type_name = "";
+template<> constexpr char const* type_name<bf16> = "_bf16";
+template<> constexpr char const* type_name<fp16> = "_fp16";
+
+// a is [I, J] or [J, I] if transA, b is [J, K] or [K, J] if transB
+template<bool transA, bool transB, int I, int J, int K, class T = float>
+void bench_mat_mul(json_report & report, std::mt19937 & rng)
+{
+    std::string name = std::string("mat_mul") + type_name<T> + "/" + (transA ? "t" : "n") + (transB ? "t" : "n")
+        + "/" + std::to_string(I) + "x" + std::to_string(J) + "x" + std::to_string(K);
+    if(!report.wants(name)) { return; }
+
+    std::conditional_t<transA, heap_tensor<T, J, I>, heap_tensor<T, I, J>> a;
+    std::conditional_t<transB, heap_tensor<T, K, J>, heap_tensor<T, J, K>> b;
+    randomize(a, rng);
+    randomize(b, rng);
+    report.run(name, 2.0 * I * J * K, "flop/s", [&] {
+        auto c = mat_mul<transA, transB>(a, b);
+        sink = c.raw()[0];
+    });
+}
+
+template<int I, int J, int K>
+void bench_mat_mul_all(json_report & report, std::mt19937 & rng)
+{
+    bench_mat_mul<false, false, I, J, K>(report, rng);
+    bench_mat_mul<false, true, I, J, K>(report, rng);
+    bench_mat_mul<true, false, I, J, K>(report, rng);
+    bench_mat_mul<true, true, I, J, K>(report, rng);
+}
+
+// half storage, float accumulation
+template<int I, int J, int K>
+void bench_mat_mul_half(json_report & report, std::mt19937 & rng)
+{
+    bench_mat_mul<false, false, I, J, K, bf16>(report, rng);
+    bench_mat_mul<false, true, I, J, K, bf16>(report, rng);
+    bench_mat_mul<false, false, I, J, K, fp16>(report, rng);
+}
+
+// int8 weights, x quantized per row on the way in
+template<int I, int J, int K>
+void bench_qmat_mul(json_report & report, std::mt19937 & rng)
+{
+    std::string name = "qmat_mul/" + std::to_string(I) + "x" + std::to_string(J) + "x" + std::to_string(K);
+    if(!report.wants(name)) { return; }
+
+    heap_tensor<float, I, J> a;
+    heap_tensor<float, J, K> b;
+    randomize(a, rng);
+    randomize(b, rng);
+    auto qb = quantize(b);
+    report.run(name, 2.0 * I * J * K, "op/s", [&] {
+        auto c = a % qb;
+        sink = c.raw()[0];
+    });
+}
+
+void bench_elementwise(json_report & report, std::mt19937 & rng)
+{
+    constexpr int B = 16;
+    constexpr int N = 256;
+    tensor<float, B, N> a, b, c;
+    tensor<float, N> row;
+    tensor<float, B, 1> col;
+    randomize(a, rng);
+    randomize(b, rng);
+    randomize(row, rng);
+    randomize(col, rng);
+
+    report.run("elementwise/add/16x256", B * N, "elem/s", [&] { c = a + b; sink = c(0, 0); });
+    report.run("elementwise/add_row/16x256+256", B * N, "elem/s", [&] { c = a + row; sink = c(0, 0); });
+    report.run("elementwise/mul_col/16x256*16x1", B * N, "elem/s", [&] { c = a * col; sink = c(0, 0); });
+    report.run("elementwise/lazy_chain/16x256", B * N, "elem/s", [&] {
+        c = lazy(a) * b + row - col;
+        sink = c(0, 0);
+    });
+    report.run("elementwise/exp/16x256", B * N, "elem/s", [&] { c = exp(a); sink = c(0, 0); });
+    report.run("elementwise/log/16x256", B * N, "elem/s", [&] { c = log(b); sink = c(0, 0); });
+    report.run("elementwise/sigmoid/16x256", B * N, "elem/s", [&] { c = sigmoid(a); sink = c(0, 0); });
+    report.run("elementwise/tanh/16x256", B * N, "elem/s", [&] { c = tanh(a); sink = c(0, 0); });
+}
+
+void bench_softmax(json_report & report, std::mt19937 & rng)
+{
+    constexpr int B = 16;
+    constexpr int V = 256;
+    var<tensor<float, B, V>> x {0};
+    randomize(x.value, rng);
+    tensor<float, B, 1> g1 = 1;
+    tensor<float, B, V> gv = 1;
+    tensor<int, B> target;
+    for(int b=0 ; b<B ; b++) { target(b) = b * 7 % V; }
+
+    report.run("softmax/logsumexp_nograd/16x256", B * V, "elem/s", [&] {
+        auto y = logsumexp(value(x));
+        sink = y.raw()[0];
+    });
+    report.run("softmax/logsumexp/16x256", B * V, "elem/s", [&] {
+        auto y = logsumexp(x);
+        y.backward(g1);
+    });
+    report.run("softmax/log_softmax/16x256", B * V, "elem/s", [&] {
+        auto y = log_softmax(x);
+        y.backward(gv);
+    });
+    report.run("softmax/cross_entropy/16x256", B * V, "elem/s", [&] {
+        auto y = cross_entropy(x, target);
+        y.backward(1);
+    });
+}
+
+// the cost of the coroutine itself: frame allocation, run to the yield, resume and destroy
+// and of small ops, where that cost dominates the math
+void bench_op(json_report & report)
+{
+    using T = tensor<float, 4>;
+    var<T> a {2};
+    var<T> b {3};
+    auto identity = [] (var<T> & x) -> op<var<T>> { co_yield x; };
+
+    report.run("op/identity", 1, "op/s", [&] {
+        auto y = identity(a);
+        sink = value(y)(0);
+    });
+    report.run("op/mul_4", 1, "op/s", [&] {
+        auto y = a * b;
+        y.backward(1);
+    });
+    report.run("op/chain_8x4", 8, "op/s", [&] {
+        auto y1 = a * b;
+        auto y2 = y1 + a;
+        auto y3 = y2 * y1;
+        auto y4 = y3 - b;
+        auto y5 = y4 * y4;
+        auto y6 = y5 + y3;
+        auto y7 = y6 * a;
+        auto y8 = y7 + b;
+        y8.backward(1);
+    });
+}
+
+void bench_gru(json_report & report, std::mt19937 & rng)
+{
+    constexpr int B = 16;
+    constexpr int N = 64;
+    var<tensor<float, B, N>> x {0}, h {0};
+    var<tensor<float, N, 3*N>> w_x {0}, w_h {0};
+    var<tensor<float, 3*N>> b {0};
+    tensor<float, B, N> dy;
+    randomize(x.value, rng);
+    randomize(h.value, rng);
+    randomize(w_x.value, rng);
+    randomize(w_h.value, rng);
+    randomize(dy, rng);
+
+    // one matmul each for x and h, and the backward ones
+    double flops = 2.0 * B * N * 3*N * 2;
+    report.run("gru/forward_nograd/16x64", flops, "flop/s", [&] {
+        auto y = gru_cell(value(x), value(h), value(w_x), value(w_h), value(b));
+        sink = y(0, 0);
+    });
+    report.run("gru/forward_backward/16x64", flops * 3, "flop/s", [&] {
+        auto y = gru_cell(x, h, w_x, w_h, b);
+        y.backward(dy);
+    });
+}
+
+// the train_gru loop over its text, the first 64KB of it when found
+void bench_train(json_report & report)
+{
+    if(!report.wants("train_gru/chars")) { return; }
+
+    std::stringstream ss;
+    ss << std::ifstream("data/alice.txt").rdbuf();
+    std::string text = ss.str().substr(0, 1 << 16);
+    while(text.size() < (1 << 16)) { text += "the quick brown fox jumps over the lazy dog. "; }
+
+    constexpr int Nchunk = 8;
+    constexpr int Nbatch = 16;
+    gaii::optim::sgd opt { .lr = 0.0003 };
+    using Model = CharModel<decltype(opt), 256, 256, 64, Nbatch>;
+    Model model {opt};
+    std::deque<Worker<Model, Nbatch, 64>> workers;
+    workers.emplace_back(text, Nchunk);
+
+    int Nsteps = (workers[0].streams.length - 1) / Nchunk;
+    gaii::data_parallel dp { .opt = opt, .workers = 1 };
+    auto t0 = std::chrono::steady_clock::now();
+    dp.run(Nsteps, [&] (int w, int step) {
+        train_chunk(workers[w], step * Nchunk, model, false);
+    });
+    std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+
+    double chars = double(Nsteps) * Nchunk * Nbatch;
+    report.add("train_gru/chars", dt.count() / chars, 1, "char/s");
+}
+
+
+int main(int argc, char ** argv)
+{
+    std::mt19937 rng;
+    json_report report(std::cout, argc > 1 ? argv[1] : "");
+
+    bench_mat_mul_all<1, 64, 192>(report, rng);
+    bench_mat_mul_all<16, 64, 192>(report, rng);
+    bench_mat_mul_all<16, 256, 256>(report, rng);
+    bench_mat_mul_all<64, 64, 64>(report, rng);
+    bench_mat_mul_all<128, 128, 128>(report, rng);
+    bench_mat_mul_all<256, 256, 256>(report, rng);
+    bench_mat_mul_half<16, 256, 256>(report, rng);
+    bench_mat_mul_half<256, 256, 256>(report, rng);
+    bench_qmat_mul<16, 256, 256>(report, rng);
+    bench_qmat_mul<256, 256, 256>(report, rng);
+
+    bench_elementwise(report, rng);
+    bench_softmax(report, rng);
+    bench_op(report);
+    bench_gru(report, rng);
+    bench_train(report);
+}
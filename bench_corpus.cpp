@@ -0,0 +1,92 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <gaii/corpus.h>
+
+using namespace gaii;
+
+// corpus read rate, with one cursor per thread each summing the bytes it sees
+//
+//   bench_corpus [path] [threads] [window]
+//
+// path - reads stdin in chunks, so `cat big.txt | bench_corpus -` measures the pipe.
+// without a path, the text in data/ is repeated into a 256MB file under /tmp,
+// which is then read both mapped and in chunks. window is the bytes each call
+// asks for, 9 bytes stepping by 8 is what train_gru reads per stream per chunk
+
+
+long run(corpus & text, int threads, std::size_t window)
+{
+    std::vector<long> sums(threads);
+    std::vector<std::thread> pool;
+    for(int w=0 ; w<threads ; w++)
+    {
+        pool.emplace_back([&, w] {
+            auto cur = text.open(w, threads);
+            long sum = 0;
+            while(char const* p = cur.next(window, window > 1 ? window - 1 : 1))
+            {
+                for(std::size_t i=0 ; i<window ; i++) { sum += p[i]; }
+            }
+            sums[w] = sum;
+        });
+    }
+    for(auto & t : pool) { t.join(); }
+    long sum = 0;
+    for(long s : sums) { sum += s; }
+    return sum;
+}
+
+// two cursors drained one after the other on one thread, streamed in small
+// chunks, so the first has to get past chunks that wait for the second
+void drain_in_turn(std::string const& path)
+{
+    corpus text(path, { .chunk = 1 << 16, .stream = true });
+    if(!text.good()) { return; }
+    auto a = text.open(0, 2);
+    auto b = text.open(1, 2);
+    long sum = 0;
+    while(char const* p = a.next(1, 1)) { sum += *p; }
+    while(char const* p = b.next(1, 1)) { sum += *p; }
+    std::cout << "two cursors, one thread  " << text.consumed / 1e6 << " MB  checksum " << sum << std::endl;
+}
+
+void report(char const* name, std::string const& path, corpus_options opt, int threads, std::size_t window)
+{
+    corpus text(path, opt);
+    if(!text.good()) { std::cout << "can't open " << path << std::endl; return; }
+    long sum = run(text, threads, window);
+    std::cout << name << (text.mapped() ? " (mapped)" : " (chunks)")
+        << "  " << text.consumed / 1e6 << " MB"
+        << "  " << text.bytes_per_sec() / 1e9 << " GB/s"
+        << "  checksum " << sum << std::endl;
+}
+
+
+int main(int argc, char ** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "";
+    int threads = argc > 2 ? std::atoi(argv[2]) : 1;
+    std::size_t window = argc > 3 ? std::atoi(argv[3]) : 4097;
+
+    if(path.empty())
+    {
+        path = "/tmp/gaii_corpus.txt";
+        std::stringstream ss;
+        ss << std::ifstream("data/alice.txt").rdbuf();
+        std::string text = ss.str();
+        if(text.empty()) { text = "the quick brown fox jumps over the lazy dog. "; }
+        std::ofstream out(path, std::ios::binary);
+        for(std::size_t n=0 ; n<(256 << 20) ; n+=text.size()) { out << text; }
+    }
+
+    std::cout << threads << " cursors, " << window << " byte windows" << std::endl;
+    report("file ", path, {}, threads, window);
+    if(path == "-") { return 0; }
+    report("file ", path, { .stream = true }, threads, window);
+    report("train", path, {}, threads, 9);
+    drain_in_turn(path);
+}
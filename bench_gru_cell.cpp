@@ -0,0 +1,225 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gaii/rnn.h>
+
+using namespace gaii;
+
+// gru_cell against the same cell composed from math.h ops:
+// outputs and gradients should match, and the fused op should be faster
+
+constexpr int B = 16;
+constexpr int Nin = 64;
+constexpr int N = 64;
+
+struct Weights
+{
+    var<tensor<float, Nin, 3*N>> w_x {0};
+    var<tensor<float, N, 3*N>> w_h {0};
+    var<tensor<float, 3*N>> b {0};
+};
+
+// the composed cell needs each gate's weights on their own
+template<int Rows>
+void split(tensor<float, Rows, 3*N> const& w, var<tensor<float, Rows, N>> (&out)[3])
+{
+    for(int g=0 ; g<3 ; g++)
+        for(int i=0 ; i<Rows ; i++)
+            for(int j=0 ; j<N ; j++)
+            {
+                out[g].value(i, j) = w(i, g*N + j);
+            }
+}
+
+template<int Rows>
+tensor<float, Rows, 3*N> join(var<tensor<float, Rows, N>> const (&in)[3])
+{
+    tensor<float, Rows, 3*N> out;
+    for(int g=0 ; g<3 ; g++)
+        for(int i=0 ; i<Rows ; i++)
+            for(int j=0 ; j<N ; j++)
+            {
+                out(i, g*N + j) = in[g].grad(i, j);
+            }
+    return out;
+}
+
+struct Composed
+{
+    var<tensor<float, Nin, N>> w_x[3];
+    var<tensor<float, N, N>> w_h[3];
+    var<tensor<float, N>> b[3];
+
+    Composed(Weights const& w)
+    {
+        split(w.w_x.value, w_x);
+        split(w.w_h.value, w_h);
+        for(int g=0 ; g<3 ; g++)
+            for(int j=0 ; j<N ; j++)
+            {
+                b[g].value(j) = w.b.value(g*N + j);
+            }
+    }
+
+    op<var<tensor<float, B, N>>> operator()(
+        var<tensor<float, B, Nin>> & x,
+        var<tensor<float, B, N>> & h)
+    {
+        auto z = sigmoid(x % w_x[0] + h % w_h[0] + b[0]);
+        auto r = sigmoid(x % w_x[1] + h % w_h[1] + b[1]);
+        auto n = tanh(x % w_x[2] + r * (h % w_h[2]) + b[2]);
+        auto hh = (1 - z) * h + z * n;
+        co_yield hh;
+    }
+};
+
+template<class T>
+float max_diff(T const& a, T const& b)
+{
+    float d = 0;
+    for(int i=0 ; i<T::size() ; i++)
+    {
+        d = std::max(d, std::abs(a.raw()[i] - b.raw()[i]));
+    }
+    return d;
+}
+
+template<class F>
+double time_us(F && f, int iters)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i=0 ; i<iters ; i++) { f(); }
+    std::chrono::duration<double, std::micro> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count() / iters;
+}
+
+
+// gru_sequence against T gru_cell steps, same weights and output gradients
+void sequence(Weights const& w, std::mt19937 & rng)
+{
+    constexpr int T = 32;
+    std::uniform_real_distribution<float> dist {-0.5, 0.5};
+    auto fill = [&] (auto & t) { t.apply([&] (auto & v) { v = dist(rng); }); };
+
+    Weights w1, w2;
+    w1.w_x.value = w2.w_x.value = w.w_x.value;
+    w1.w_h.value = w2.w_h.value = w.w_h.value;
+    w1.b.value = w2.b.value = w.b.value;
+
+    var<auto_tensor_t<float, T, B, Nin>> xs {0};
+    auto_tensor_t<float, T, B, N> dys;
+    var<tensor<float, B, N>> h1 {0}, h2 {0};
+    fill(xs.value);
+    fill(dys);
+    fill(h1.value);
+    h2.value = h1.value;
+
+    std::vector<var<tensor<float, B, Nin>>> x1(T);
+    for(int t=0 ; t<T ; t++) { x1[t].value = xs.value[t]; }
+
+    auto cells = [&] (auto & w, auto & h, auto & x, auto & ys) {
+        std::vector<op<var<tensor<float, B, N>>>> steps;
+        steps.reserve(T);
+        for(int t=0 ; t<T ; t++)
+        {
+            auto & hp = steps.empty() ? h : *steps.back();
+            steps.push_back(gru_cell(x[t], hp, w.w_x, w.w_h, w.b));
+            steps.back().backward(dys[t]);
+            ys[t] = value(steps.back());
+        }
+        while(!steps.empty()) { steps.pop_back(); }
+    };
+    auto seq = [&] (auto & w, auto & h, auto & x, auto & ys) {
+        auto y = gru_sequence(x, h, w.w_x, w.w_h, w.b);
+        y.backward(dys);
+        ys = value(y);
+    };
+
+    auto_tensor_t<float, T, B, N> ys1, ys2;
+    cells(w1, h1, x1, ys1);
+    seq(w2, h2, xs, ys2);
+
+    float dx = 0;
+    for(int t=0 ; t<T ; t++) { dx = std::max(dx, max_diff(x1[t].grad, xs.grad[t])); }
+    std::cout << "sequence of " << T << " against cells" << std::endl;
+    std::cout << "max |y| diff     " << max_diff(ys1, ys2) << std::endl;
+    std::cout << "max |dx| diff    " << dx << std::endl;
+    std::cout << "max |dh| diff    " << max_diff(h1.grad, h2.grad) << std::endl;
+    std::cout << "max |dw_x| diff  " << max_diff(w1.w_x.grad, w2.w_x.grad) << std::endl;
+    std::cout << "max |dw_h| diff  " << max_diff(w1.w_h.grad, w2.w_h.grad) << std::endl;
+    std::cout << "max |db| diff    " << max_diff(w1.b.grad, w2.b.grad) << std::endl;
+
+    // as a training loop under data_parallel would, reuse the [T, B, *] buffers
+    heap_cache_scope cache;
+    constexpr int iters = 100;
+    double t_cells = time_us([&] { cells(w1, h1, x1, ys1); }, iters);
+    double t_seq = time_us([&] { seq(w2, h2, xs, ys2); }, iters);
+    std::cout << "cells    " << t_cells / T << " us/step" << std::endl;
+    std::cout << "sequence " << t_seq / T << " us/step" << std::endl;
+}
+
+
+int main()
+{
+    std::mt19937 rng;
+    std::uniform_real_distribution<float> dist {-0.5, 0.5};
+    auto fill = [&] (auto & t) { t.apply([&] (auto & v) { v = dist(rng); }); };
+
+    Weights w;
+    fill(w.w_x.value);
+    fill(w.w_h.value);
+    fill(w.b.value);
+    Composed c {w};
+
+    var<tensor<float, B, Nin>> x1 {0}, x2 {0};
+    var<tensor<float, B, N>> h1 {0}, h2 {0};
+    tensor<float, B, N> dy;
+    fill(x1.value);
+    fill(h1.value);
+    fill(dy);
+    x2.value = x1.value;
+    h2.value = h1.value;
+
+    tensor<float, B, N> y1, y2;
+    {
+        auto y = gru_cell(x1, h1, w.w_x, w.w_h, w.b);
+        y.backward(dy);
+        y1 = value(y);
+    }
+    {
+        auto y = c(x2, h2);
+        y.backward(dy);
+        y2 = value(y);
+    }
+
+    std::cout << "max |y| diff     " << max_diff(y1, y2) << std::endl;
+    std::cout << "max |dx| diff    " << max_diff(x1.grad, x2.grad) << std::endl;
+    std::cout << "max |dh| diff    " << max_diff(h1.grad, h2.grad) << std::endl;
+    std::cout << "max |dw_x| diff  " << max_diff(w.w_x.grad, join(c.w_x)) << std::endl;
+    std::cout << "max |dw_h| diff  " << max_diff(w.w_h.grad, join(c.w_h)) << std::endl;
+
+    tensor<float, 3*N> db;
+    for(int g=0 ; g<3 ; g++)
+        for(int j=0 ; j<N ; j++)
+        {
+            db(g*N + j) = c.b[g].grad(j);
+        }
+    std::cout << "max |db| diff    " << max_diff(w.b.grad, db) << std::endl;
+
+    constexpr int iters = 2000;
+    double fused = time_us([&] {
+        auto y = gru_cell(x1, h1, w.w_x, w.w_h, w.b);
+        y.backward(dy);
+    }, iters);
+    double composed = time_us([&] {
+        auto y = c(x2, h2);
+        y.backward(dy);
+    }, iters);
+
+    std::cout << "fused    " << fused << " us/step" << std::endl;
+    std::cout << "composed " << composed << " us/step" << std::endl;
+
+    sequence(w, rng);
+}
@@ -0,0 +1,142 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <gaii/optim.h>
+
+using namespace gaii;
+
+// fused optimizer kernels against plain scalar loops of the same math:
+// results should match, and the fused pass should run near memory bandwidth.
+// bytes count each array read once and written once per element, and the
+// reference is the simplest pass of that shape, v += g and g = 0
+// arrays are well past the last level cache
+
+constexpr int N = 1 << 25;
+
+template<class F>
+double time_s(F && f, int iters)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i=0 ; i<iters ; i++) { f(); }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count() / iters;
+}
+
+float max_diff(std::vector<float> const& a, std::vector<float> const& b)
+{
+    float d = 0;
+    for(size_t i=0 ; i<a.size() ; i++) { d = std::max(d, std::abs(a[i] - b[i])); }
+    return d;
+}
+
+float clamp_abs(float x, float limit) { return std::min(std::max(x, -limit), limit); }
+
+// reference updates, one element at a time
+void sgd_scalar(optim::sgd const& o, float * v, float * g, float * vel, int n)
+{
+    for(int i=0 ; i<n ; i++)
+    {
+        float d = clamp_abs(g[i], o.grad_clamp);
+        if(o.momentum != 0)
+        {
+            vel[i] = o.momentum * vel[i] + d;
+            d = o.nesterov ? d + o.momentum * vel[i] : vel[i];
+        }
+        v[i] = clamp_abs(v[i] - o.lr * d, o.param_clamp);
+        g[i] = 0;
+    }
+}
+
+template<bool Decoupled>
+void adam_scalar(optim::adam_t<Decoupled> const& o, float * v, float * g, float * a, float * b, int n, int t)
+{
+    float c1 = 1 / (1 - std::pow(o.beta1, t));
+    float c2 = 1 / (1 - std::pow(o.beta2, t));
+    for(int i=0 ; i<n ; i++)
+    {
+        float gi = clamp_abs(g[i], o.grad_clamp);
+        if(Decoupled) { v[i] *= 1 - o.lr * o.weight_decay; }
+        else { gi += o.weight_decay * v[i]; }
+        a[i] = o.beta1 * a[i] + (1 - o.beta1) * gi;
+        b[i] = o.beta2 * b[i] + (1 - o.beta2) * gi * gi;
+        v[i] = clamp_abs(v[i] - o.lr * c1 * a[i] / (std::sqrt(c2 * b[i]) + o.eps), o.param_clamp);
+        g[i] = 0;
+    }
+}
+
+struct State
+{
+    std::vector<float> v, g, s1, s2;
+};
+
+
+int main()
+{
+    std::mt19937 rng;
+    std::uniform_real_distribution<float> dist {-0.5, 0.5};
+    std::vector<float> init(N), grad(N);
+    for(auto & x : init) { x = dist(rng); }
+    for(auto & x : grad) { x = dist(rng); }
+
+    State fused {init, grad, std::vector<float>(N), std::vector<float>(N)};
+    State scalar = fused;
+
+    // grads are zeroed by each update, so put them back between runs
+    auto refill = [&] (State & s) { std::memcpy(s.g.data(), grad.data(), N * sizeof(float)); };
+
+    constexpr int iters = 10;
+    double stream = time_s([&] {
+        simd_loop<float>(N, [&] <class S> (int i) {
+            S::store(fused.v.data() + i, S::add(S::load(fused.v.data() + i), S::load(fused.g.data() + i)));
+            S::store(fused.g.data() + i, S::zero());
+        });
+    }, iters);
+    double peak = 16.0 * N / stream / 1e9;
+    std::cout << "stream             " << peak << " GB/s" << std::endl;
+
+    auto report = [&] (char const* name, int bytes, auto && run_fused, auto && run_scalar) {
+        fused = {init, grad, std::vector<float>(N), std::vector<float>(N)};
+        scalar = fused;
+        for(int t=1 ; t<=3 ; t++)
+        {
+            refill(fused);
+            refill(scalar);
+            run_fused(fused, t);
+            run_scalar(scalar, t);
+        }
+        double tf = time_s([&] { run_fused(fused, 4); }, iters);
+        double ts = time_s([&] { run_scalar(scalar, 4); }, iters);
+        double gbs = double(bytes) * N / tf / 1e9;
+        std::cout << name
+            << " max diff " << max_diff(fused.v, scalar.v)
+            << "  fused " << gbs << " GB/s (" << int(100 * gbs / peak) << "% of stream)"
+            << "  scalar " << double(bytes) * N / ts / 1e9 << " GB/s" << std::endl;
+    };
+
+    optim::sgd sgd;
+    report("sgd               ", 16,
+        [&] (State & s, int) { sgd.kernel(s.v.data(), s.g.data(), s.s1.data(), N); },
+        [&] (State & s, int) { sgd_scalar(sgd, s.v.data(), s.g.data(), s.s1.data(), N); });
+
+    optim::sgd momentum { .momentum = 0.9 };
+    report("sgd momentum      ", 24,
+        [&] (State & s, int) { momentum.kernel(s.v.data(), s.g.data(), s.s1.data(), N); },
+        [&] (State & s, int) { sgd_scalar(momentum, s.v.data(), s.g.data(), s.s1.data(), N); });
+
+    optim::sgd nesterov { .momentum = 0.9, .nesterov = true };
+    report("sgd nesterov      ", 24,
+        [&] (State & s, int) { nesterov.kernel(s.v.data(), s.g.data(), s.s1.data(), N); },
+        [&] (State & s, int) { sgd_scalar(nesterov, s.v.data(), s.g.data(), s.s1.data(), N); });
+
+    optim::adam adam { .weight_decay = 0.01 };
+    report("adam              ", 32,
+        [&] (State & s, int t) { adam.kernel(s.v.data(), s.g.data(), s.s1.data(), s.s2.data(), N, t); },
+        [&] (State & s, int t) { adam_scalar(adam, s.v.data(), s.g.data(), s.s1.data(), s.s2.data(), N, t); });
+
+    optim::adamw adamw;
+    report("adamw             ", 32,
+        [&] (State & s, int t) { adamw.kernel(s.v.data(), s.g.data(), s.s1.data(), s.s2.data(), N, t); },
+        [&] (State & s, int t) { adam_scalar(adamw, s.v.data(), s.g.data(), s.s1.data(), s.s2.data(), N, t); });
+}
@@ -0,0 +1,178 @@
+#include <chrono>
+#include <sstream>
+#include <fstream>
+
+#include "train_gru.h"
+
+using namespace gaii;
+
+// stacked GRU layers trained a chunk at a time, in a loop on one thread
+// and as a pipeline with a thread per layer, at growing depth
+//
+//   bench_pipeline [max depth] [chunk]
+//
+// both runs start from the same weights, and must end with the same ones.
+// the speedup can only approach the depth with a core per layer
+
+
+constexpr int N = 128;
+constexpr int B = 16;
+
+// like CharModel, with a runtime number of residual GRU layers
+template<class Optimizer>
+struct DeepRNN
+{
+    using Hidden = var<tensor<float, B, N>>;
+
+    Optimizer & opt;
+    Embedding<Optimizer, 256, N, B> w_in {opt};
+    Linear<Optimizer, N, 256, B> w_out {opt};
+    std::deque<GRU<Optimizer, N, N, B>> rnn;
+
+    DeepRNN(Optimizer & opt, int depth) : opt(opt)
+    {
+        for(int l=0 ; l<depth ; l++) { rnn.emplace_back(opt); }
+    }
+
+    struct Layer
+    {
+        Hidden & out;
+        Hidden & h;
+    };
+    op<Layer> layer(int l, Hidden & x, Hidden & h)
+    {
+        auto r = rnn[l](x, h);
+        auto y = x + r;
+        co_yield {y, r};
+    }
+};
+
+using Model = DeepRNN<optim::sgd>;
+using Input = decltype(std::declval<Model &>().w_in(std::declval<tensor<int, B> const&>()));
+using Output = decltype(std::declval<Model &>().w_out(std::declval<Model::Hidden &>()));
+
+struct Serial
+{
+    bptt<Input> inputs;
+    bptt<op<Model::Layer>> layers;
+    bptt<Output> outputs;
+    std::vector<Model::Hidden> h;
+
+    Serial(int T, int depth) : inputs(T), layers(T * depth), outputs(T), h(depth) {}
+
+    void chunk(Model & model, TextStreams<B> const& streams, int offset)
+    {
+        int T = inputs.capacity();
+        int depth = h.size();
+        for(int t=0 ; t<T ; t++)
+        {
+            tensor<int, B> input, target;
+            for(int b=0 ; b<B ; b++) { input(b) = streams(b, offset+t); target(b) = streams(b, offset+t+1); }
+            Model::Hidden * x = &*inputs.push(model.w_in(input));
+            for(int l=0 ; l<depth ; l++)
+            {
+                auto & hl = t == 0 ? h[l] : layers[(t-1) * depth + l]->h;
+                x = &layers.push(model.layer(l, *x, hl))->out;
+            }
+            auto & out = outputs.push(model.w_out(*x));
+            cross_entropy(*out, target).backward(1);
+        }
+        std::vector<tensor<float, B, N>> last;
+        for(int l=0 ; l<depth ; l++) { last.push_back(layers[(T-1) * depth + l]->h.value); }
+        for(int t=T-1 ; t>=0 ; t--)
+        {
+            outputs.pop();
+            for(int l=depth-1 ; l>=0 ; l--) { layers.pop(); }
+            inputs.pop();
+        }
+        for(int l=0 ; l<depth ; l++) { h[l] = { last[l] }; }
+    }
+};
+
+struct Pipelined
+{
+    bptt<Input> inputs;
+    bptt<Output> outputs;
+    rnn_pipeline<op<Model::Layer>> pipe;
+
+    Pipelined(int T, Model & model)
+    :   inputs(T), outputs(T),
+        pipe(model.rnn.size(), T, [&model] (int l, auto & x, auto & h) { return model.layer(l, x, h); })
+    {}
+
+    void chunk(Model & model, TextStreams<B> const& streams, int offset)
+    {
+        pipe.forward(inputs.capacity(),
+            [&] (int t) -> auto & {
+                tensor<int, B> input;
+                for(int b=0 ; b<B ; b++) { input(b) = streams(b, offset+t); }
+                return *inputs.push(model.w_in(input));
+            },
+            [&] (int t, auto & x) {
+                tensor<int, B> target;
+                for(int b=0 ; b<B ; b++) { target(b) = streams(b, offset+t+1); }
+                auto & out = outputs.push(model.w_out(x));
+                cross_entropy(*out, target).backward(1);
+            });
+        pipe.backward([&] (int) { outputs.pop(); }, [&] (int) { inputs.pop(); });
+    }
+};
+
+// chars per second over the chunks, after one to warm up
+template<class Runner>
+double train(Runner & runner, Model & model, optim::sgd & opt, TextStreams<B> const& streams, int T, int chunks)
+{
+    runner.chunk(model, streams, 0);
+    opt.end_step();
+    auto t0 = std::chrono::steady_clock::now();
+    for(int c=1 ; c<=chunks ; c++)
+    {
+        runner.chunk(model, streams, c * T);
+        opt.end_step();
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    return double(chunks) * T * B / dt.count();
+}
+
+
+int main(int argc, char ** argv)
+{
+    int max_depth = argc > 1 ? std::atoi(argv[1]) : 8;
+    int T = argc > 2 ? std::atoi(argv[2]) : 32;
+    constexpr int chunks = 8;
+
+    std::stringstream ss;
+    ss << std::ifstream("data/alice.txt").rdbuf();
+    std::string text = ss.str();
+    while(text.size() < std::size_t(B * T * (chunks + 2))) { text += "the quick brown fox jumps over the lazy dog. "; }
+    TextStreams<B> streams {text};
+
+    std::cout << std::thread::hardware_concurrency() << " cores, "
+        << B << " streams, " << N << " wide, chunks of " << T << std::endl;
+    for(int depth=1 ; depth<=max_depth ; depth*=2)
+    {
+        optim::sgd o1, o2;
+        Model m1 {o1, depth};
+        Model m2 {o2, depth};
+        save_weights("/tmp/bench_pipeline.weights", o1);
+        load_weights("/tmp/bench_pipeline.weights", o2);
+
+        Serial serial {T, depth};
+        Pipelined pipelined {T, m2};
+        double loop = train(serial, m1, o1, streams, T, chunks);
+        double pipe = train(pipelined, m2, o2, streams, T, chunks);
+
+        bool same = true;
+        for(std::size_t i=0 ; i<o1.params.slots.size() ; i++)
+        {
+            auto & a = o1.params.slots[i];
+            auto & b = o2.params.slots[i];
+            same = same && std::equal(a.value, a.value + a.size, b.value);
+        }
+        std::cout << "depth " << depth
+            << "  loop " << loop << " char/s"
+            << "  pipeline " << pipe << " char/s"
+            << "  speedup " << pipe / loop << "x"
+            << (same ? "" : "  WEIGHTS DIFFER") << std::endl;
+    }
+}
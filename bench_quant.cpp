@@ -0,0 +1,154 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "train_gru.h"
+
+using namespace gaii;
+
+// int8 against fp32 for the char model: train on the first 90% of the text,
+// quantize, then compare both on the rest
+//
+//   accuracy   mean log p of the next char, how often it is the top guess,
+//              how often both models agree on the top guess, and the largest
+//              logit difference
+//   speed      each matmul shape in the model, and whole steps of the model
+
+
+constexpr int Nbatch = 16;
+constexpr int Nembed = 64;
+
+template<class F>
+double time_ns(F && f)
+{
+    auto run = [&] (long iters) {
+        auto t0 = std::chrono::steady_clock::now();
+        for(long i=0 ; i<iters ; i++) { f(); }
+        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+        return dt.count() / iters;
+    };
+    long iters = 1;
+    while(run(iters) * iters < 2e7) { iters *= 2; }
+    double best = run(iters);
+    for(int r=1 ; r<5 ; r++) { best = std::min(best, run(iters)); }
+    return best;
+}
+
+volatile float sink;
+
+template<int I, int J, int K>
+void bench_shape(std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> dist {-1, 1};
+    auto_tensor_t<float, I, J> x;
+    auto_tensor_t<float, J, K> w;
+    x.apply([&] (auto & v) { v = dist(rng); });
+    w.apply([&] (auto & v) { v = dist(rng); });
+    auto qw = quantize(w);
+
+    constexpr int J4 = qweights<J, K>::J4;
+    auto_tensor_t<int8_t, I, J4> qx = 1;
+    auto_tensor_t<int32_t, I, K> acc;
+
+    double ops = 2.0 * I * J * K;
+    double fp32 = time_ns([&] { auto y = x % w; sink = y.raw()[0]; });
+    double int8 = time_ns([&] { auto y = x % qw; sink = y.raw()[0]; });
+    double gemm = time_ns([&] { qgemm<I>(qx.raw(), qw, acc.raw()); sink = acc.raw()[0]; });
+    std::cout << "  " << I << "x" << J << "x" << K
+        << "  fp32 " << ops / fp32 << " Gop/s"
+        << "  int8 " << ops / int8 << " Gop/s"
+        << "  qgemm only " << ops / gemm << " Gop/s"
+        << "  speedup " << fp32 / int8 << "x" << std::endl;
+}
+
+
+struct eval_stats
+{
+    double logp = 0;
+    long top1 = 0;
+    long count = 0;
+};
+
+void score(eval_stats & s, tensor<float, Nbatch, 256> const& logits, tensor<int, Nbatch> const& target)
+{
+    auto lse = logsumexp(logits);
+    for(int b=0 ; b<Nbatch ; b++)
+    {
+        auto row = logits[b];
+        s.logp += row(target(b)).item() - lse(b).item();
+        s.top1 += std::max_element(row.raw(), row.raw() + 256) - row.raw() == target(b);
+        s.count ++;
+    }
+}
+
+
+int main()
+{
+    std::stringstream ss;
+    ss << std::ifstream("data/alice.txt").rdbuf();
+    std::string text = ss.str();
+    while(text.size() < (1 << 16)) { text += "the quick brown fox jumps over the lazy dog. "; }
+    std::string train = text.substr(0, text.size() * 9 / 10);
+    std::string test = text.substr(train.size());
+
+    gaii::optim::sgd opt { .lr = 0.0003 };
+    using Model = CharModel<decltype(opt), 256, 256, Nembed, Nbatch>;
+    Model model {opt};
+    std::deque<Worker<Model, Nbatch, Nembed>> workers;
+    workers.emplace_back(train, 8);
+    int Nsteps = (workers[0].streams.length - 1) / 8;
+    gaii::data_parallel dp { .opt = opt, .workers = 1 };
+    dp.run(Nsteps, [&] (int w, int step) { train_chunk(workers[w], step * 8, model, false); });
+
+    QCharModel<256, 256, Nembed, Nbatch> qmodel {model};
+
+    // both models over the held out text, B streams side by side
+    TextStreams<Nbatch> streams {test};
+    tensor<float, Nbatch, Nembed> h[2][2] = {{0, 0}, {0, 0}};
+    eval_stats fp32, int8;
+    long agree = 0;
+    float max_diff = 0;
+    for(int t=0 ; t+1<streams.length ; t++)
+    {
+        tensor<int, Nbatch> x, target;
+        for(int b=0 ; b<Nbatch ; b++) { x(b) = streams(b, t); target(b) = streams(b, t+1); }
+
+        auto [y, f0, f1] = model(x, h[0][0], h[0][1]);
+        auto [qy, q0, q1] = qmodel(x, h[1][0], h[1][1]);
+        h[0][0] = f0; h[0][1] = f1;
+        h[1][0] = q0; h[1][1] = q1;
+
+        score(fp32, y, target);
+        score(int8, qy, target);
+        for(int b=0 ; b<Nbatch ; b++)
+        {
+            auto fy = y[b].raw();
+            auto iy = qy[b].raw();
+            agree += std::max_element(fy, fy + 256) - fy == std::max_element(iy, iy + 256) - iy;
+            for(int i=0 ; i<256 ; i++) { max_diff = std::max(max_diff, std::abs(fy[i] - iy[i])); }
+        }
+    }
+
+    std::cout << "accuracy over " << fp32.count << " held out chars" << std::endl;
+    std::cout << "  fp32  log p " << fp32.logp / fp32.count << "  top1 " << double(fp32.top1) / fp32.count << std::endl;
+    std::cout << "  int8  log p " << int8.logp / int8.count << "  top1 " << double(int8.top1) / int8.count << std::endl;
+    std::cout << "  top1 agreement " << double(agree) / fp32.count
+        << "  max logit diff " << max_diff << std::endl;
+
+    std::mt19937 rng;
+    std::cout << "matmul, with per-row quantization of x for int8" << std::endl;
+    bench_shape<1, 64, 192>(rng);
+    bench_shape<16, 64, 192>(rng);
+    bench_shape<16, 64, 256>(rng);
+    bench_shape<16, 256, 768>(rng);
+    bench_shape<256, 256, 256>(rng);
+
+    tensor<int, Nbatch> x = 'e';
+    tensor<float, Nbatch, Nembed> h0 = 0.1f, h1 = -0.1f;
+    double t_fp32 = time_ns([&] { auto v = model(x, h0, h1); sink = v.out(0, 0); });
+    double t_int8 = time_ns([&] { auto v = qmodel(x, h0, h1); sink = v.out(0, 0); });
+    std::cout << "model step, " << Nbatch << " streams" << std::endl;
+    std::cout << "  fp32 " << Nbatch / t_fp32 * 1e9 << " char/s"
+        << "  int8 " << Nbatch / t_int8 * 1e9 << " char/s"
+        << "  speedup " << t_fp32 / t_int8 << "x" << std::endl;
+}
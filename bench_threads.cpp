@@ -0,0 +1,114 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <gaii/tensor.h>
+#include <gaii/math.h>
+#include <gaii/rnn.h>
+
+using namespace gaii;
+
+// intra-op scaling: each shape at 1, 2, 4 ... threads, as a speedup over 1
+//
+//   bench_threads [max threads] [threshold] [gemm threshold]
+//
+// max threads defaults to the core count. results are checked against the
+// serial ones. the small shapes are the char model's, which should stay
+// serial under the default thresholds and so not move at all
+
+
+template<class F>
+double time_ns(F && f)
+{
+    auto run = [&] (long iters) {
+        auto t0 = std::chrono::steady_clock::now();
+        for(long i=0 ; i<iters ; i++) { f(); }
+        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+        return dt.count() / iters;
+    };
+    long iters = 1;
+    while(run(iters) * iters < 2e7) { iters *= 2; }
+    double best = run(iters);
+    for(int r=1 ; r<5 ; r++) { best = std::min(best, run(iters)); }
+    return best;
+}
+
+volatile float sink;
+
+template<tensor_ref T>
+void randomize(T & t, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> dist {-1, 1};
+    t.apply([&] (auto & v) { v = dist(rng); });
+}
+
+template<tensor_ref T>
+float max_diff(T const& a, T const& b)
+{
+    float d = 0;
+    for(int i=0 ; i<T::size() ; i++) { d = std::max(d, std::abs(a.raw()[i] - b.raw()[i])); }
+    return d;
+}
+
+// f() makes a tensor, timed and compared at each thread count
+template<class F>
+void scale(char const* name, int max_threads, F && f)
+{
+    auto & pool = intra_op_pool();
+    pool.resize(1);
+    auto ref = f();
+    double t1 = time_ns([&] { auto y = f(); sink = y.raw()[0]; });
+    std::cout << name << "  1: " << t1 / 1e3 << " us";
+    for(int n=2 ; n<=max_threads ; n*=2)
+    {
+        pool.resize(n);
+        float d = max_diff(ref, f());
+        double tn = time_ns([&] { auto y = f(); sink = y.raw()[0]; });
+        std::cout << "  " << n << ": " << t1 / tn << "x";
+        if(d > 0) { std::cout << " (diff " << d << ")"; }
+    }
+    std::cout << std::endl;
+}
+
+
+int main(int argc, char ** argv)
+{
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    auto & pool = intra_op_pool();
+    if(argc > 2) { pool.threshold = std::atol(argv[2]); }
+    if(argc > 3) { pool.gemm_threshold = std::atol(argv[3]); }
+    std::cout << "up to " << max_threads << " threads, threshold " << pool.threshold
+        << ", gemm threshold " << pool.gemm_threshold << std::endl;
+
+    std::mt19937 rng;
+    heap_tensor<float, 2048, 1024> x, y;
+    tensor<float, 1024> bias;
+    randomize(x, rng);
+    randomize(y, rng);
+    randomize(bias, rng);
+    scale("add      2048x1024      ", max_threads, [&] { return x + y; });
+    scale("bias     2048x1024      ", max_threads, [&] { return x + bias; });
+    scale("mul      2048x1024 lazy ", max_threads, [&] { return heap_tensor<float, 2048, 1024>(lazy(x) * y); });
+    scale("lse rows 2048x1024      ", max_threads, [&] { return logsumexp(x); });
+
+    heap_tensor<float, 512, 512> a, b;
+    heap_tensor<float, 256, 768> w;
+    randomize(a, rng);
+    randomize(b, rng);
+    randomize(w, rng);
+    scale("mat_mul  512x512x512    ", max_threads, [&] { return a % b; });
+    scale("mat_mul  512x512x512 nt ", max_threads, [&] { return mat_mul<false, true>(a, b); });
+    scale("mat_mul  512x256x768    ", max_threads, [&] { return slice<0, 256, 1>(a) % w; });
+
+    tensor<float, 16, 64> xs, hs;
+    tensor<float, 64, 192> wx, wh;
+    tensor<float, 192> bg;
+    randomize(xs, rng);
+    randomize(hs, rng);
+    randomize(wx, rng);
+    randomize(wh, rng);
+    randomize(bg, rng);
+    scale("gru_cell 16x64          ", max_threads, [&] { return gru_cell(xs, hs, wx, wh, bg); });
+    scale("add      16x64          ", max_threads, [&] { return xs + hs; });
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <gaii/vmath.h>
+
+using namespace gaii;
+
+// accuracy and throughput of each vmath level against double precision:
+// max ulp, relative and absolute error over the sampled range, and elements
+// per second on a block that stays in L1
+
+constexpr int N = 1 << 20;
+constexpr int Nblock = 1 << 12;
+
+template<class F>
+double time_s(F && f, int iters)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i=0 ; i<iters ; i++) { f(); }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count() / iters;
+}
+
+double ulps(float y, double ref)
+{
+    float r = ref;
+    float ulp = std::nextafter(std::abs(r), std::numeric_limits<float>::infinity()) - std::abs(r);
+    return std::abs(y - ref) / ulp;
+}
+
+void report(char const* name, std::vector<float> const& x,
+    void (*f)(float const*, float *, int), double (*ref)(double))
+{
+    std::vector<float> y(x.size());
+    f(x.data(), y.data(), x.size());
+
+    double max_ulp = 0;
+    double max_rel = 0;
+    double max_abs = 0;
+    for(size_t i=0 ; i<x.size() ; i++)
+    {
+        double r = ref(x[i]);
+        max_ulp = std::max(max_ulp, ulps(y[i], r));
+        max_rel = std::max(max_rel, std::abs(y[i] - r) / std::abs(r));
+        max_abs = std::max(max_abs, std::abs(y[i] - r));
+    }
+    // a spread of inputs from the whole range
+    std::vector<float> xb(Nblock);
+    for(int i=0 ; i<Nblock ; i++) { xb[i] = x[i * (x.size() / Nblock)]; }
+    double t = time_s([&] { f(xb.data(), y.data(), Nblock); }, 20000);
+
+    std::cout << name
+        << "  max ulp " << max_ulp
+        << "  max rel " << max_rel
+        << "  max abs " << max_abs
+        << "  " << Nblock / t / 1e9 << " G/s" << std::endl;
+}
+
+double ref_exp(double x) { return std::exp(x); }
+double ref_log(double x) { return std::log(x); }
+double ref_sigmoid(double x) { return 1 / (1 + std::exp(-x)); }
+double ref_tanh(double x) { return std::tanh(x); }
+
+template<math_level L>
+void run(char const* level, std::vector<float> const& x, std::vector<float> const& xlog)
+{
+    std::cout << level << std::endl;
+    report("  exp    ", x, vexp<L>, ref_exp);
+    report("  log    ", xlog, vlog<L>, ref_log);
+    report("  sigmoid", x, vsigmoid<L>, ref_sigmoid);
+    report("  tanh   ", x, vtanh<L>, ref_tanh);
+}
+
+
+int main()
+{
+    // evenly over [-20, 20], and log evenly in exponent over [1e-30, 1e30]
+    // tanh is exactly 0 at 0, which has no relative error, so skip it
+    std::vector<float> x(N), xlog(N);
+    for(int i=0 ; i<N ; i++)
+    {
+        x[i] = -20 + 40 * (i + 0.5) / N;
+        xlog[i] = std::pow(10.0, -30 + 60 * (i + 0.5) / N);
+    }
+
+    run<math_level::fast>("fast", x, xlog);
+    run<math_level::poly>("poly", x, xlog);
+    run<math_level::exact>("exact", x, xlog);
+}
@@ -0,0 +1,41 @@
+#include <chrono>
+
+#include "train_gru.h"
+
+// samples from the weights train_gru saved, without copying them in
+//
+//   generate_gru [path] [length]
+//
+// the model's params are views into the mapped file, so the time to the first
+// char is an mmap and the page faults of one step, not a read of every weight
+
+
+int main(int argc, char ** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "train_gru.weights";
+    int length = argc > 2 ? std::atoi(argv[2]) : 400;
+    constexpr int Nbatch = 16;
+
+    auto t0 = std::chrono::steady_clock::now();
+    gaii::mapped_weights file(path);
+    CharModel<gaii::mapped_weights, 256, 256, 64, Nbatch> model {file};
+    if(!file.good() || file.unbound())
+    {
+        std::cout << path << ": " << (file.good() ? "params left over" : file.error) << std::endl;
+        return 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    // one run, so the sample carries on from the first char's state
+    std::mt19937 rng;
+    auto t2 = t1;
+    bool first = true;
+    std::string sample = generate<Nbatch, 64>(model, '\n', length, rng, [&] (char) {
+        if(first) { t2 = std::chrono::steady_clock::now(); first = false; }
+    });
+
+    std::chrono::duration<double, std::milli> load = t1 - t0, step = t2 - t1;
+    std::cout << "mapped " << file.map_size << " bytes in " << load.count() << " ms, "
+        << "first char after " << step.count() << " ms" << std::endl;
+    std::cout << sample << std::endl;
+}
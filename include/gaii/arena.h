@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+namespace gaii {
+
+
+// coroutine frames are allocated through the frame_allocator that is
+// current on the calling thread, and freed through the one that allocated them
+
+struct frame_allocator
+{
+    virtual ~frame_allocator() = default;
+    virtual void * allocate(std::size_t n) = 0;
+    virtual void deallocate(void * p, std::size_t n) noexcept = 0;
+};
+
+
+struct heap_frame_allocator : frame_allocator
+{
+    void * allocate(std::size_t n) override { return ::operator new(n); }
+    void deallocate(void * p, std::size_t n) noexcept override { ::operator delete(p, n); }
+};
+
+
+struct frame_stats
+{
+    std::size_t frames = 0;      // total allocations
+    std::size_t live_frames = 0;
+    std::size_t bytes = 0;       // arena bytes in use, including headers
+    std::size_t peak_bytes = 0;
+    std::size_t heap_blocks = 0; // blocks requested from operator new
+};
+
+
+// bump allocator for frames that die in (nearly) LIFO order
+// an op moved into a later frame is freed before its new owner,
+// so frees out of order are marked dead and popped once they reach the top
+// blocks are kept after growing, so a steady-state loop never touches the heap
+struct stack_arena : frame_allocator
+{
+    static constexpr std::size_t ALIGN = alignof(std::max_align_t);
+    static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+
+    struct header
+    {
+        header * prev;
+        std::size_t size;
+        bool live;
+    };
+
+    struct block
+    {
+        block * prev = nullptr;
+        block * next = nullptr;
+        std::size_t capacity = 0;
+        std::size_t top = 0;
+        header * last = nullptr;
+
+        std::byte * data() { return reinterpret_cast<std::byte *>(this) + round_up(sizeof(block)); }
+    };
+
+    static constexpr std::size_t round_up(std::size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+    block * m_head = nullptr;
+    block * m_current = nullptr;
+    frame_stats m_stats;
+
+    stack_arena() = default;
+    stack_arena(stack_arena const&) = delete;
+    stack_arena & operator=(stack_arena const&) = delete;
+
+    ~stack_arena()
+    {
+        for(block * b = m_head ; b ; )
+        {
+            block * next = b->next;
+            ::operator delete(b);
+            b = next;
+        }
+    }
+
+    void * allocate(std::size_t n) override
+    {
+        std::size_t need = round_up(sizeof(header)) + round_up(n);
+        block * b = m_current;
+        while(!b || b->top + need > b->capacity)
+        {
+            if(b && b->next && b->next->top + need <= b->next->capacity)
+            {
+                b = b->next;
+                break;
+            }
+            b = grow(b, need);
+        }
+        m_current = b;
+
+        auto * h = reinterpret_cast<header *>(b->data() + b->top);
+        *h = { b->last, need, true };
+        b->last = h;
+        b->top += need;
+
+        m_stats.frames ++;
+        m_stats.live_frames ++;
+        m_stats.bytes += need;
+        m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.bytes);
+
+        return reinterpret_cast<std::byte *>(h) + round_up(sizeof(header));
+    }
+
+    void deallocate(void * p, std::size_t) noexcept override
+    {
+        auto * h = reinterpret_cast<header *>(
+            static_cast<std::byte *>(p) - round_up(sizeof(header)));
+        h->live = false;
+        m_stats.live_frames --;
+
+        // pop every dead frame off the top, stepping back through blocks
+        block * b = m_current;
+        while(b)
+        {
+            if(!b->last)
+            {
+                if(!b->prev) { break; }
+                b = b->prev;
+                continue;
+            }
+            if(b->last->live) { break; }
+            m_stats.bytes -= b->last->size;
+            b->top = reinterpret_cast<std::byte *>(b->last) - b->data();
+            b->last = b->last->prev;
+        }
+        m_current = b;
+    }
+
+    frame_stats const& stats() const { return m_stats; }
+    void reset_peak() { m_stats.peak_bytes = m_stats.bytes; }
+
+private:
+    // link a fresh block after b, dropping a spare that is too small
+    block * grow(block * b, std::size_t need)
+    {
+        block * spare = b ? b->next : m_head;
+        block * after = spare ? spare->next : nullptr;
+        if(spare)
+        {
+            if(b) { b->next = after; } else { m_head = after; }
+            if(after) { after->prev = b; }
+            ::operator delete(spare);
+        }
+
+        std::size_t capacity = std::max(BLOCK_SIZE, need);
+        auto * nb = new (::operator new(round_up(sizeof(block)) + capacity)) block;
+        nb->capacity = capacity;
+        nb->prev = b;
+        nb->next = b ? b->next : m_head;
+        if(nb->next) { nb->next->prev = nb; }
+        if(b) { b->next = nb; } else { m_head = nb; }
+        m_stats.heap_blocks ++;
+        return nb;
+    }
+};
+
+
+inline stack_arena & thread_arena()
+{
+    thread_local stack_arena arena;
+    return arena;
+}
+
+inline frame_allocator *& current_frame_allocator()
+{
+#ifdef GAII_HEAP_FRAMES
+    static heap_frame_allocator heap;
+    thread_local frame_allocator * current = &heap;
+#else
+    thread_local frame_allocator * current = &thread_arena();
+#endif
+    return current;
+}
+
+
+// RAII swap of the current thread's frame allocator
+struct frame_allocator_scope
+{
+    frame_allocator * m_prev;
+
+    frame_allocator_scope(frame_allocator & alloc)
+    :   m_prev(current_frame_allocator())
+    {
+        current_frame_allocator() = &alloc;
+    }
+    frame_allocator_scope(frame_allocator_scope const&) = delete;
+    ~frame_allocator_scope() { current_frame_allocator() = m_prev; }
+};
+
+
+// each frame is prefixed with its allocator, so it can be freed
+// after the current allocator has been swapped
+inline constexpr std::size_t FRAME_PREFIX = alignof(std::max_align_t);
+
+inline void * allocate_frame(std::size_t n)
+{
+    frame_allocator * alloc = current_frame_allocator();
+    auto * p = static_cast<std::byte *>(alloc->allocate(n + FRAME_PREFIX));
+    *reinterpret_cast<frame_allocator **>(p) = alloc;
+    return p + FRAME_PREFIX;
+}
+
+inline void deallocate_frame(void * frame, std::size_t n) noexcept
+{
+    auto * p = static_cast<std::byte *>(frame) - FRAME_PREFIX;
+    frame_allocator * alloc = *reinterpret_cast<frame_allocator **>(p);
+    alloc->deallocate(p, n + FRAME_PREFIX);
+}
+
+
+} // namespace gaii
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "gaii/op.h"
+
+#include <cassert>
+#include <vector>
+
+namespace gaii {
+
+
+// truncated backprop through time over a runtime number of steps
+//
+//   bptt<op<Output>> steps {T};
+//   for(int t=0 ; t<T ; t++)
+//   {
+//       auto & h = steps.empty() ? h0 : steps.back()->h;
+//       auto & y = steps.push(model(x[t], h));
+//       ...
+//   }
+//   steps.backward();
+//
+// step ops are kept in a ring allocated once up front, instead of one stack
+// frame per step, and destroyed newest first, which runs backward from the
+// last step to the first. the ring is reused for the next chunk
+
+template<class Step>
+struct bptt
+{
+    std::vector<Step> m_steps;
+    int m_capacity;
+
+    bptt(int capacity)
+    :   m_capacity(capacity)
+    {
+        m_steps.reserve(capacity);
+    }
+    bptt(bptt const&) = delete;
+
+    ~bptt() { backward(); }
+
+    int capacity() const { return m_capacity; }
+    int size() const { return m_steps.size(); }
+    bool empty() const { return m_steps.empty(); }
+    bool full() const { return size() == m_capacity; }
+
+    Step & back() { return m_steps.back(); }
+    Step & operator[](int t) { return m_steps[t]; }
+
+    Step & push(Step && step)
+    {
+        assert(!full());
+        m_steps.push_back(std::move(step));
+        return m_steps.back();
+    }
+
+    // unwind the newest step
+    void pop()
+    {
+        assert(!empty());
+        m_steps.pop_back();
+    }
+
+    // unwind every step, newest first
+    void backward()
+    {
+        while(!m_steps.empty()) { m_steps.pop_back(); }
+    }
+};
+
+
+} // namespace gaii
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "gaii/math.h"
+
+#include <tuple>
+
+namespace gaii {
+
+
+// run fn without a graph, keep only its inputs and output,
+// and build the graph again from the inputs when backward comes
+//
+//   auto h1 = checkpoint([&] (auto & x, auto & h) { return rnn(x, h); }, x, h);
+//
+// fn is called once with plain values (no-grad) and once with vars,
+// so it must accept both, as modules with a no-grad overload do
+// params referenced by fn are read again at recompute time
+
+
+// fresh leaf for each diffable input, anything else is passed as is
+template<class A>
+auto checkpoint_leaf(A & a)
+{
+    if constexpr ( diffable<A> )
+    {
+        return var<std::remove_cvref_t<decltype(value(a))>> { value(a) };
+    }
+    else { return std::remove_cvref_t<A>(a); }
+}
+
+template<class F, class... A>
+auto checkpoint(F && fn, A &&... inputs)
+{
+    using Out = std::remove_cvref_t<decltype(eval(fn(value(inputs)...)))>;
+
+    return [] (F fn, A... a) -> op<var<Out>> {
+        var<Out> y {eval(fn(value(a)...))};
+        co_yield y;
+
+        std::tuple leaves {checkpoint_leaf<A>(a)...};
+        std::apply([&] (auto &... l) {
+            {
+                auto inner = fn(l...);
+                inner.backward(y.grad);
+            }
+            // inner graph is gone, hand the leaf grads to the real inputs
+            ([&] {
+                if constexpr ( diffable<A> ) { backward(a, l.grad); }
+            }(), ...);
+        }, leaves);
+    }(fwd<F>(fn), fwd<A>(inputs)...);
+}
+
+
+} // namespace gaii
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gaii {
+
+
+// a text corpus read in place, for more text than should be copied around
+//
+//   corpus text("data/alice.txt");            // or "-" for stdin
+//   auto cur = text.open(w, workers);         // every workers'th chunk, from w
+//   while(char const* x = cur.next(n, step)) { ...x[0:n]... }
+//
+// a regular file is mapped, and a window is a pointer into the mapping. pipes,
+// or anything with .stream set, are read in chunks into buffers. either way a
+// thread keeps the next chunks ready ahead of the cursors, paging them in or
+// reading them, so training rarely waits on the disk
+//
+// each chunk carries the first overlap bytes of the one after it, so a window
+// of up to overlap + 1 bytes is always contiguous. cursors take chunks round
+// robin, so n cursors split a corpus n ways without knowing its length, and a
+// cursor keeps its offset past the end of a chunk into its next one, which
+// is exact when there is only one cursor
+
+struct corpus_options
+{
+    std::size_t chunk = 1 << 20;
+    std::size_t overlap = 4096;
+    int prefetch = 4;     // chunks kept ready ahead of the cursors, more if one is waited on
+    bool stream = false;  // read files in chunks as well, instead of mapping them
+};
+
+
+struct corpus
+{
+    struct chunk
+    {
+        char const* data = nullptr; // null past the end
+        std::size_t own = 0;        // bytes in this chunk
+        std::size_t size = 0;       // and the lookahead after them
+        std::shared_ptr<std::vector<char>> buffer; // when streamed
+    };
+
+    struct cursor
+    {
+        corpus * src;
+        long index;
+        int stride;
+        chunk current;
+        std::size_t at = 0;
+
+        // n bytes at the current position, then step on, null at the end
+        // the window is valid until the next call
+        char const* next(std::size_t n, std::size_t step)
+        {
+            while(current.data && at >= current.own)
+            {
+                at -= current.own;
+                current = src->take(index += stride);
+            }
+            if(!current.data || at + n > current.size) { return nullptr; }
+            char const* p = current.data + at;
+            at += step;
+            src->consumed += step;
+            return p;
+        }
+    };
+
+    corpus_options opt;
+    int fd = -1;
+    char const* map = nullptr;
+    std::size_t map_size = 0;
+    int cursors = 0;
+    std::atomic<long> consumed = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::map<long, chunk> ready; // streamed chunks not taken yet
+    long wanted = 0;             // furthest chunk a cursor has asked for
+    bool done = false;           // no more chunks will be read
+    std::atomic<bool> stop = false;
+    std::thread worker;
+
+    corpus(std::string const& path, corpus_options opt = {})
+    :   opt(opt)
+    {
+        fd = path == "-" ? 0 : ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) { done = true; return; }
+
+        struct stat st;
+        if(!opt.stream && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void * p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED)
+            {
+                map = static_cast<char const*>(p);
+                map_size = st.st_size;
+                worker = std::thread([this] { page_in(); });
+                return;
+            }
+        }
+        worker = std::thread([this] { read_ahead(); });
+    }
+    corpus(corpus const&) = delete;
+
+    ~corpus()
+    {
+        {
+            std::lock_guard l(lock);
+            stop = true;
+        }
+        cv.notify_all();
+        if(worker.joinable()) { worker.join(); }
+        if(map) { munmap(const_cast<char *>(map), map_size); }
+        if(fd > 0) { ::close(fd); }
+    }
+
+    bool good() const { return fd >= 0; }
+    bool mapped() const { return map; }
+
+    // the whole text, when mapped
+    std::string_view view() const { return { map, map_size }; }
+
+    cursor open(int first = 0, int stride = 1)
+    {
+        {
+            std::lock_guard l(lock);
+            cursors ++;
+        }
+        return { this, first, stride, take(first) };
+    }
+
+    // bytes stepped over by all cursors, per second since the corpus was opened
+    double bytes_per_sec() const
+    {
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+        return consumed / dt.count();
+    }
+
+    chunk take(long k)
+    {
+        std::unique_lock l(lock);
+        if(k > wanted) { wanted = k; cv.notify_all(); }
+
+        if(map)
+        {
+            std::size_t begin = k * opt.chunk;
+            if(begin >= map_size) { return {}; }
+            std::size_t own = std::min(opt.chunk, map_size - begin);
+            std::size_t size = std::min(own + opt.overlap, map_size - begin);
+            return { map + begin, own, size, nullptr };
+        }
+
+        cv.wait(l, [&] { return ready.count(k) || done; });
+        auto it = ready.find(k);
+        if(it == ready.end()) { return {}; }
+        chunk c = std::move(it->second);
+        ready.erase(it);
+        cv.notify_all();
+        return c;
+    }
+
+    // mapped: ask for the pages of the next chunks, and touch them so they are in
+    void page_in()
+    {
+        long pages = (map_size + opt.chunk - 1) / opt.chunk;
+        for(long k=0 ; k<pages ; k++)
+        {
+            {
+                std::unique_lock l(lock);
+                cv.wait(l, [&] { return stop || k <= wanted + opt.prefetch; });
+                if(stop) { return; }
+            }
+            std::size_t begin = k * opt.chunk;
+            std::size_t size = std::min(opt.chunk, map_size - begin);
+            madvise(const_cast<char *>(map) + begin, size, MADV_WILLNEED);
+            volatile char sink = 0;
+            for(std::size_t i=0 ; i<size ; i+=4096) { sink = sink + map[begin + i]; }
+        }
+    }
+
+    // read, or -1 once stopping, so a pipe with nothing to say can't hold up the destructor
+    ssize_t read_some(char * p, std::size_t n)
+    {
+        pollfd pfd { fd, POLLIN, 0 };
+        while(!stop)
+        {
+            int r = poll(&pfd, 1, 100);
+            if(r > 0) { return ::read(fd, p, n); }
+            if(r < 0 && errno != EINTR) { return -1; }
+        }
+        return -1;
+    }
+
+    // streamed: read chunks in order, each starting with the lookahead of the last
+    void read_ahead()
+    {
+        std::vector<char> carry;
+        for(long k=0 ; ; k++)
+        {
+            {
+                std::unique_lock l(lock);
+                // past the limit only for a chunk a cursor already asked for, since
+                // chunks go round robin, one cursor can wait on k while chunks for
+                // a cursor that isn't reading yet fill the queue
+                cv.wait(l, [&] { return stop || long(ready.size()) < opt.prefetch + cursors || k <= wanted; });
+                if(stop) { break; }
+            }
+            auto buffer = std::make_shared<std::vector<char>>(opt.chunk + opt.overlap);
+            std::size_t size = carry.size();
+            std::memcpy(buffer->data(), carry.data(), size);
+            while(size < buffer->size())
+            {
+                ssize_t n = read_some(buffer->data() + size, buffer->size() - size);
+                if(n <= 0) { break; }
+                size += n;
+            }
+            if(size == 0) { break; }
+
+            std::size_t own = std::min(opt.chunk, size);
+            carry.assign(buffer->data() + own, buffer->data() + size);
+            {
+                std::lock_guard l(lock);
+                ready[k] = { buffer->data(), own, size, buffer };
+            }
+            cv.notify_all();
+        }
+        {
+            std::lock_guard l(lock);
+            done = true;
+        }
+        cv.notify_all();
+    }
+};
+
+
+} // namespace gaii
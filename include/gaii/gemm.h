@@ -0,0 +1,288 @@
+#pragma once
+
+#include "gaii/half.h"
+#include "gaii/simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace gaii {
+
+
+// MR x NR block of C held in registers, NR = NV * W
+// c[m, 0:NR] (+)= sum_j a[m*AI + j*AJ] * b[j*bj + 0:NR]
+// a may be half storage, each element is widened as it is broadcast
+template<int MR, int NV, int AI, int AJ, class Ta, class T>
+void gemm_tile(int J, Ta const* a, T const* b, int bj, T * c, int ci, bool accumulate)
+{
+    using S = simd<T>;
+    typename S::reg acc[MR][NV];
+
+    for(int m=0 ; m<MR ; m++)
+        for(int v=0 ; v<NV ; v++)
+        {
+            acc[m][v] = accumulate ? S::load(c + m*ci + v*S::W) : S::zero();
+        }
+
+    for(int j=0 ; j<J ; j++)
+    {
+        typename S::reg bv[NV];
+        for(int v=0 ; v<NV ; v++) { bv[v] = S::load(b + j*bj + v*S::W); }
+        for(int m=0 ; m<MR ; m++)
+        {
+            auto av = S::set1(a[m*AI + j*AJ]);
+            for(int v=0 ; v<NV ; v++) { acc[m][v] = S::fmadd(av, bv[v], acc[m][v]); }
+        }
+    }
+
+    for(int m=0 ; m<MR ; m++)
+        for(int v=0 ; v<NV ; v++)
+        {
+            S::store(c + m*ci + v*S::W, acc[m][v]);
+        }
+}
+
+
+// NK dot products along contiguous j, for few rows against a transposed B
+// c[0:NK] = sum_j a[j] * b[n*bk + j]
+template<int NK, int J, class T>
+void gemm_dot(T const* a, T const* b, int bk, T * c)
+{
+    using S = simd<T>;
+    constexpr int J0 = J / S::W * S::W;
+    typename S::reg acc[NK];
+
+    for(int n=0 ; n<NK ; n++) { acc[n] = S::zero(); }
+    for(int j=0 ; j<J0 ; j+=S::W)
+    {
+        auto av = S::load(a + j);
+        for(int n=0 ; n<NK ; n++) { acc[n] = S::fmadd(av, S::load(b + n*bk + j), acc[n]); }
+    }
+    for(int n=0 ; n<NK ; n++)
+    {
+        T out = S::reduce(acc[n]);
+        for(int j=J0 ; j<J ; j++) { out += a[j] * b[n*bk + j]; }
+        c[n] = out;
+    }
+}
+
+
+#if defined(__AVX512BF16__) && defined(__AVX512BW__)
+
+// bf16 tile on the native pair dot, c += a[j]*b[j] + a[j+1]*b[j+1] per float lane
+// b is packed as [J/2, NR, 2], and a pair of a is broadcast as one 32 bit lane
+template<int MR, int NV, int AI, int AJ>
+void gemm_tile_bf16(int J, bf16 const* a, bf16 const* b, float * c, int ci, bool accumulate)
+{
+    __m512 acc[MR][NV];
+
+    for(int m=0 ; m<MR ; m++)
+        for(int v=0 ; v<NV ; v++)
+        {
+            acc[m][v] = accumulate ? _mm512_loadu_ps(c + m*ci + v*16) : _mm512_setzero_ps();
+        }
+
+    // the last pair of an odd J is padded with 0
+    auto pair = [&] (int m, int j) {
+        uint32_t p;
+        if constexpr ( AJ == 1 ) { if(j+1 < J) { std::memcpy(&p, a + m*AI + j, 4); return p; } }
+        uint32_t hi = j+1 < J ? a[m*AI + (j+1)*AJ].bits : 0;
+        return uint32_t(a[m*AI + j*AJ].bits) | hi << 16;
+    };
+
+    for(int j=0 ; j<J ; j+=2)
+    {
+        __m512bh bv[NV];
+        for(int v=0 ; v<NV ; v++) { bv[v] = (__m512bh)_mm512_loadu_si512(b + j*NV*16 + v*32); }
+        for(int m=0 ; m<MR ; m++)
+        {
+            auto av = (__m512bh)_mm512_set1_epi32(pair(m, j));
+            for(int v=0 ; v<NV ; v++) { acc[m][v] = _mm512_dpbf16_ps(acc[m][v], av, bv[v]); }
+        }
+    }
+
+    for(int m=0 ; m<MR ; m++)
+        for(int v=0 ; v<NV ; v++)
+        {
+            _mm512_storeu_ps(c + m*ci + v*16, acc[m][v]);
+        }
+}
+
+// rows j and j+1 of a 32 column panel interleaved into pairs, 64 bf16
+template<int BJ, int BK>
+void gemm_pack_bf16(bf16 const* b, bool odd, bf16 * out)
+{
+    if constexpr ( BK == 1 )
+    {
+        __m512i r0 = _mm512_loadu_si512(b);
+        __m512i r1 = odd ? _mm512_setzero_si512() : _mm512_loadu_si512(b + BJ);
+        __m512i lo = _mm512_set_epi16(47, 15, 46, 14, 45, 13, 44, 12, 43, 11, 42, 10, 41, 9, 40, 8,
+            39, 7, 38, 6, 37, 5, 36, 4, 35, 3, 34, 2, 33, 1, 32, 0);
+        __m512i hi = _mm512_add_epi16(lo, _mm512_set1_epi16(16));
+        _mm512_storeu_si512(out, _mm512_permutex2var_epi16(r0, lo, r1));
+        _mm512_storeu_si512(out + 32, _mm512_permutex2var_epi16(r0, hi, r1));
+    }
+    else
+    {
+        for(int n=0 ; n<32 ; n++)
+        {
+            out[2*n] = b[n*BK];
+            out[2*n + 1].bits = odd ? 0 : b[BJ + n*BK].bits;
+        }
+    }
+}
+
+#endif
+
+
+// out[I,K] = A[I,J] @ B[J,K], where A(i,j) = a[i*AI + j*AJ], B(j,k) = b[j*BJ + k*BK]
+// so the transposed variants are just different strides
+//
+// bf16 and fp16 inputs accumulate in float: B is widened as it is packed, and A
+// as it is read, or with avx512 bf16 both stay bf16 and go to the pair dot
+template<int I, int J, int K, int AI, int AJ, int BJ, int BK, class Ta, class Tb, class Tc>
+void gemm(Ta const* a, Tb const* b, Tc * out)
+{
+    constexpr bool same = std::is_same_v<Ta, Tc> && std::is_same_v<Tb, Tc>;
+    constexpr bool widen = std::is_same_v<compute_t<Ta>, Tc> && std::is_same_v<compute_t<Tb>, Tc>;
+
+    if constexpr ( !widen )
+    {
+        for(int i=0 ; i<I ; i++)
+            for(int k=0 ; k<K ; k++)
+            {
+                Tc acc = 0;
+                for(int j=0 ; j<J ; j++) { acc += a[i*AI + j*AJ] * b[j*BJ + k*BK]; }
+                out[i*K + k] = acc;
+            }
+    }
+#if defined(__AVX512BF16__) && defined(__AVX512BW__)
+    else if constexpr ( std::is_same_v<Ta, bf16> && std::is_same_v<Tb, bf16> && std::is_same_v<Tc, float> )
+    {
+        constexpr int MR = 8;
+        constexpr int NV = 2;
+        constexpr int NR = NV * 16;
+        constexpr int KC = std::min((J + 1) / 2 * 2, 256);
+        constexpr int I0 = I / MR * MR;
+        constexpr int K0 = K / NR * NR;
+
+        alignas(64) bf16 pack[KC * NR];
+
+        for(int k0=0 ; k0<K0 ; k0+=NR)
+        {
+            for(int j0=0 ; j0<J ; j0+=KC)
+            {
+                int jc = std::min(KC, J - j0);
+                for(int j=0 ; j<jc ; j+=2)
+                {
+                    gemm_pack_bf16<BJ, BK>(b + (j0+j)*BJ + k0*BK, j+1 == jc, pack + j*NR);
+                }
+
+                bf16 const* ap = a + j0*AJ;
+                float * cp = out + k0;
+                for(int i0=0 ; i0<I0 ; i0+=MR)
+                {
+                    gemm_tile_bf16<MR, NV, AI, AJ>(jc, ap + i0*AI, pack, cp + i0*K, K, j0 > 0);
+                }
+                for(int i0=I0 ; i0<I ; i0++)
+                {
+                    gemm_tile_bf16<1, NV, AI, AJ>(jc, ap + i0*AI, pack, cp + i0*K, K, j0 > 0);
+                }
+            }
+        }
+
+        for(int i=0 ; i<I ; i++)
+            for(int k=K0 ; k<K ; k++)
+            {
+                float acc = 0;
+                for(int j=0 ; j<J ; j++) { acc += a[i*AI + j*AJ] * b[j*BJ + k*BK]; }
+                out[i*K + k] = acc;
+            }
+    }
+#endif
+    else if constexpr ( same && AJ == 1 && BJ == 1 && I < simd<Tc>::MR )
+    {
+        // too few rows to pay for packing B, use dot products instead
+        constexpr int NK = 4;
+        constexpr int K0 = K / NK * NK;
+        for(int i=0 ; i<I ; i++)
+        {
+            for(int k=0 ; k<K0 ; k+=NK)
+            {
+                gemm_dot<NK, J>(a + i*AI, b + k*BK, BK, out + i*K + k);
+            }
+            for(int k=K0 ; k<K ; k++)
+            {
+                gemm_dot<1, J>(a + i*AI, b + k*BK, BK, out + i*K + k);
+            }
+        }
+    }
+    else
+    {
+        using T = Tc;
+        constexpr int MR = simd<T>::MR;
+        constexpr int NV = 2;
+        constexpr int NR = NV * simd<T>::W;
+        // J block, so a packed panel of B stays in L1
+        constexpr int KC = std::min(J, 256);
+        // B is packed when its rows are strided, when enough row tiles reuse it,
+        // or to widen it from half storage
+        constexpr bool PACK = BK != 1 || I >= 4 * MR || !std::is_same_v<Tb, T>;
+
+        constexpr int I0 = I / MR * MR;
+        constexpr int K0 = K / NR * NR;
+
+        alignas(64) T pack[PACK ? KC * NR : 1];
+
+        for(int k0=0 ; k0<K0 ; k0+=NR)
+        {
+            for(int j0=0 ; j0<J ; j0+=KC)
+            {
+                int jc = std::min(KC, J - j0);
+                T const* bp = pack;
+                int bj = NR;
+                if constexpr ( PACK )
+                {
+                    Tb const* bs = b + j0*BJ + k0*BK;
+                    for(int j=0 ; j<jc ; j++)
+                    {
+                        if constexpr ( BK == 1 && half_ref<Tb> ) { to_float(bs + j*BJ, pack + j*NR, NR); }
+                        else
+                        {
+                            for(int n=0 ; n<NR ; n++) { pack[j*NR + n] = bs[j*BJ + n*BK]; }
+                        }
+                    }
+                }
+                else
+                {
+                    bp = b + j0*BJ + k0*BK;
+                    bj = BJ;
+                }
+
+                Ta const* ap = a + j0*AJ;
+                T * cp = out + k0;
+                for(int i0=0 ; i0<I0 ; i0+=MR)
+                {
+                    gemm_tile<MR, NV, AI, AJ>(jc, ap + i0*AI, bp, bj, cp + i0*K, K, j0 > 0);
+                }
+                for(int i0=I0 ; i0<I ; i0++)
+                {
+                    gemm_tile<1, NV, AI, AJ>(jc, ap + i0*AI, bp, bj, cp + i0*K, K, j0 > 0);
+                }
+            }
+        }
+
+        // leftover columns
+        for(int i=0 ; i<I ; i++)
+            for(int k=K0 ; k<K ; k++)
+            {
+                T acc = 0;
+                for(int j=0 ; j<J ; j++) { acc += a[i*AI + j*AJ] * b[j*BJ + k*BK]; }
+                out[i*K + k] = acc;
+            }
+    }
+}
+
+
+} // namespace gaii
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "gaii/tensor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace gaii {
+
+
+// params stored as bf16 or fp16 keep fp32 master weights, which the optimizer
+// updates, and their value is rounded from the master after each update.
+// float params are their own master
+template<class T, bool Half = half_ref<element_type<T>>>
+struct master_weights
+{
+    master_weights(T const&) {}
+    float * raw(T & value) { return value.raw(); }
+    void round(T &, int, int) {}
+};
+
+template<class T>
+struct master_weights<T, true>
+{
+    float_tensor_t<T> master;
+
+    master_weights(T const& value) : master(value) {}
+    float * raw(T &) { return master.raw(); }
+    void round(T & value, int at, int n) { from_float(master.raw() + at, value.raw() + at, n); }
+};
+
+// the half storage a master range is rounded into, after updates over the flat range
+struct half_copy
+{
+    void * data = nullptr;
+    void (*round)(float const*, void *, int) = nullptr;
+
+    template<class H>
+    static half_copy of(H * p)
+    {
+        return { p, [] (float const* x, void * y, int n) { from_float(x, static_cast<H *>(y), n); } };
+    }
+
+    void store(float const* master, int at, int n) const
+    {
+        if(data) { round(master, static_cast<uint16_t *>(data) + at, n); }
+    }
+};
+
+
+// true if none of g[0:n] is inf or nan, 0 * x is 0 for all the others
+inline bool all_finite(float const* g, int n)
+{
+    using S = simd<float>;
+    auto acc = S::zero();
+    int i = 0;
+    for( ; i+S::W<=n ; i+=S::W) { acc = S::add(acc, S::mul(S::zero(), S::load(g + i))); }
+    float out = S::reduce(acc);
+    for( ; i<n ; i++) { out += 0 * g[i]; }
+    return out == 0;
+}
+
+
+// loss scaling, so small gradients survive bf16 and fp16 activations:
+// backward starts from scale instead of 1, and updates divide it back out
+//
+//   loss.backward(opt.loss.scale);
+//
+// when dynamic, a step whose gradients overflowed is skipped whole, the scale
+// backs off at the end of the step, and it grows after interval clean steps.
+// every gradient of the step is checked before any update, so dynamic scaling
+// defers updates to the optimizer's step(), or data_parallel's, as deferred does
+struct loss_scale
+{
+    float scale = 1;
+    bool dynamic = false;
+    float growth = 2;
+    float backoff = 0.5;
+    int interval = 1000;
+    int clean = 0;
+    std::atomic<bool> overflow = false;
+
+    // flags the step if any of g is inf or nan, shards may check from their own threads
+    void check(float const* g, int n)
+    {
+        if(dynamic && !all_finite(g, n)) { overflow = true; }
+    }
+
+    // true once the step is flagged, its updates only zero their gradients
+    bool skipping() const { return dynamic && overflow; }
+
+    void end_step()
+    {
+        if(!dynamic) { return; }
+        if(overflow) { scale *= backoff; clean = 0; }
+        else if(++clean == interval) { scale *= growth; clean = 0; }
+        overflow = false;
+    }
+};
+
+
+// params register with their optimizer on construction, which gives each one
+// a range in a flat gradient buffer, so updates can run over all params at once
+// registration order is construction order, so it is the same for every run
+struct param_registry
+{
+    struct slot
+    {
+        float * value; // the master weights
+        int offset;
+        int size;
+        half_copy copy;
+        std::vector<int> shape;
+    };
+
+    std::vector<slot> slots;
+    std::vector<float> grad; // flat, for updates deferred to a step
+
+    int size() const { return grad.size(); }
+
+    template<class Param>
+    int add(Param & p)
+    {
+        using T = decltype(p.value);
+        static_assert(std::is_same_v<compute_t<element_type<T>>, float>, "params are float or half tensors");
+
+        half_copy copy;
+        if constexpr ( half_ref<element_type<T>> ) { copy = half_copy::of(p.value.raw()); }
+
+        int offset = size();
+        auto shape = shape_of<T>();
+        slots.push_back({ p.master.raw(p.value), offset, T::size(), copy, { shape.begin(), shape.end() } });
+        grad.resize(offset + T::size(), 0);
+        return offset;
+    }
+
+    // f(value, offset, n) for each contiguous piece of the flat range [begin, end),
+    // and half params are rounded from their masters after
+    template<class F>
+    void each_range(int begin, int end, F && f)
+    {
+        for(auto & s : slots)
+        {
+            int b = std::max(begin, s.offset);
+            int e = std::min(end, s.offset + s.size);
+            if(b < e)
+            {
+                f(s.value + (b - s.offset), b, e - b);
+                s.copy.store(s.value + (b - s.offset), b - s.offset, e - b);
+            }
+        }
+    }
+
+    float * grad_sink(bool deferred);
+};
+
+
+// one gradient per registered param, flattened
+struct grad_buffer
+{
+    std::vector<float> data;
+
+    grad_buffer(param_registry const& params) : data(params.size(), 0) {}
+
+    void zero() { std::fill(data.begin(), data.end(), 0); }
+};
+
+
+// while set, params send their gradients here instead of updating
+inline grad_buffer *& thread_grads()
+{
+    thread_local grad_buffer * current = nullptr;
+    return current;
+}
+
+// RAII swap of the current thread's grad_buffer
+struct grad_buffer_scope
+{
+    grad_buffer * m_prev;
+
+    grad_buffer_scope(grad_buffer & grads)
+    :   m_prev(thread_grads())
+    {
+        thread_grads() = &grads;
+    }
+    grad_buffer_scope(grad_buffer_scope const&) = delete;
+    ~grad_buffer_scope() { thread_grads() = m_prev; }
+};
+
+
+// where a param adds its gradient instead of updating, if anywhere:
+// the thread's grad_buffer in a data parallel worker, else the flat grad
+// when updates are deferred to the optimizer's step()
+inline float * param_registry::grad_sink(bool deferred)
+{
+    if(grad_buffer * g = thread_grads()) { return g->data.data(); }
+    return deferred ? grad.data() : nullptr;
+}
+
+
+} // namespace gaii
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace gaii {
+
+
+// 16 bit float storage, math happens in float
+//
+//   bf16   float's exponent range with 8 bits of mantissa, the top half of a float
+//   fp16   ieee half, 11 bits of mantissa but nothing past 65504
+//
+// both round to nearest even from float, and convert to float implicitly, so
+// bf16 * bf16 is a float, tensor<bf16> + tensor<bf16> is a tensor<float>, and
+// mat_mul of half tensors accumulates in float. assigning into half storage rounds
+
+
+struct bf16
+{
+    uint16_t bits;
+
+    bf16() = default;
+    bf16(float x) : bits(from(x)) {}
+    operator float() const { return std::bit_cast<float>(uint32_t(bits) << 16); }
+
+    static uint16_t from(float x)
+    {
+        uint32_t u = std::bit_cast<uint32_t>(x);
+        if((u & 0x7fffffff) > 0x7f800000) { return (u >> 16) | 0x40; } // keep nan a nan
+        return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+    }
+
+    bf16 & operator+=(float b) { return *this = *this + b; }
+    bf16 & operator-=(float b) { return *this = *this - b; }
+    bf16 & operator*=(float b) { return *this = *this * b; }
+    bf16 & operator/=(float b) { return *this = *this / b; }
+};
+
+
+// https://gist.github.com/rygorous/2156668, with F16C when there is one
+struct fp16
+{
+    uint16_t bits;
+
+    fp16() = default;
+    fp16(float x) : bits(from(x)) {}
+    operator float() const { return to(bits); }
+
+    static uint16_t from(float x)
+    {
+#if defined(__F16C__)
+        return _cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT);
+#else
+        uint32_t u = std::bit_cast<uint32_t>(x);
+        uint32_t sign = (u >> 16) & 0x8000;
+        uint32_t f = u & 0x7fffffff;
+        uint32_t out;
+        if(f >= 0x47800000) { out = f > 0x7f800000 ? 0x7e00 : 0x7c00; } // nan, or inf past 65520
+        else if(f < 0x38800000)
+        {
+            // subnormal, adding 0.5 lines the mantissa up at the bottom and rounds it
+            float d = std::bit_cast<float>(f) + 0.5f;
+            out = std::bit_cast<uint32_t>(d) - 0x3f000000;
+        }
+        else
+        {
+            f += 0xc8000fff + ((f >> 13) & 1); // rebias the exponent, round to even
+            out = f >> 13;
+        }
+        return out | sign;
+#endif
+    }
+
+    static float to(uint16_t h)
+    {
+#if defined(__F16C__)
+        return _cvtsh_ss(h);
+#else
+        // scale by 2^112 to rebias, which also normalizes subnormals
+        float f = std::bit_cast<float>(uint32_t(h & 0x7fff) << 13) * 0x1p112f;
+        uint32_t u = std::bit_cast<uint32_t>(f);
+        if(f >= 65536.0f) { u |= 0x7f800000; } // inf and nan
+        return std::bit_cast<float>(u | uint32_t(h & 0x8000) << 16);
+#endif
+    }
+
+    fp16 & operator+=(float b) { return *this = *this + b; }
+    fp16 & operator-=(float b) { return *this = *this - b; }
+    fp16 & operator*=(float b) { return *this = *this * b; }
+    fp16 & operator/=(float b) { return *this = *this / b; }
+};
+
+
+template<class T>
+concept half_ref = std::same_as<std::remove_cvref_t<T>, bf16> || std::same_as<std::remove_cvref_t<T>, fp16>;
+
+// the type math on T is done in
+template<class T>
+using compute_t = std::conditional_t<half_ref<T>, float, T>;
+
+
+// n values between float and half storage, 16 lanes at a time with avx512
+
+inline void to_float(bf16 const* x, float * y, int n)
+{
+    int i = 0;
+#if defined(__AVX512F__)
+    for( ; i+16<=n ; i+=16)
+    {
+        __m512i h = _mm512_maskz_cvtepu16_epi32(0xffff, _mm256_loadu_si256((__m256i const*)(x + i)));
+        _mm512_storeu_ps(y + i, _mm512_castsi512_ps(_mm512_maskz_slli_epi32(0xffff, h, 16)));
+    }
+#endif
+    for( ; i<n ; i++) { y[i] = x[i]; }
+}
+
+inline void from_float(float const* x, bf16 * y, int n)
+{
+    int i = 0;
+#if defined(__AVX512BF16__)
+    for( ; i+16<=n ; i+=16)
+    {
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(x + i));
+        _mm256_storeu_si256((__m256i *)(y + i), (__m256i)h);
+    }
+#endif
+    for( ; i<n ; i++) { y[i] = x[i]; }
+}
+
+inline void to_float(fp16 const* x, float * y, int n)
+{
+    int i = 0;
+#if defined(__AVX512F__)
+    for( ; i+16<=n ; i+=16)
+    {
+        __m256i h = _mm256_loadu_si256((__m256i const*)(x + i));
+        _mm512_storeu_ps(y + i, _mm512_maskz_cvtph_ps(0xffff, h));
+    }
+#endif
+    for( ; i<n ; i++) { y[i] = x[i]; }
+}
+
+inline void from_float(float const* x, fp16 * y, int n)
+{
+    int i = 0;
+#if defined(__AVX512F__)
+    for( ; i+16<=n ; i+=16)
+    {
+        __m256i h = _mm512_maskz_cvtps_ph(0xffff, _mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256((__m256i *)(y + i), h);
+    }
+#endif
+    for( ; i<n ; i++) { y[i] = x[i]; }
+}
+
+
+} // namespace gaii
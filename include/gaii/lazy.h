@@ -0,0 +1,278 @@
+#pragma once
+
+#include "gaii/tensor.h"
+
+namespace gaii {
+
+// opt-in expression templates for elementwise ops
+//
+//   tensor<float, 1, 64> y = (1 - lazy(z)) * h + lazy(z) * h2;
+//
+// builds a tree of references, which is evaluated in a single broadcast
+// loop when assigned to a tensor, so no intermediate tensors are stored
+// leaves refer to their tensors, so evaluate within the same full expression
+
+
+template<class Tensor>
+struct lazy_leaf;
+
+template<class View>
+struct lazy_view;
+
+template<class T>
+struct lazy_scalar;
+
+template<class F, class A>
+struct lazy_unary;
+
+template<class F, class A, class B>
+struct lazy_binary;
+
+template<class T>
+struct is_lazy_helper<lazy_leaf<T>> { static constexpr bool value = true; };
+
+template<class T>
+struct is_lazy_helper<lazy_view<T>> { static constexpr bool value = true; };
+
+template<class T>
+struct is_lazy_helper<lazy_scalar<T>> { static constexpr bool value = true; };
+
+template<class F, class A>
+struct is_lazy_helper<lazy_unary<F, A>> { static constexpr bool value = true; };
+
+template<class F, class A, class B>
+struct is_lazy_helper<lazy_binary<F, A, B>> { static constexpr bool value = true; };
+
+
+// dims of a lazy expression, which sizes itself like a tensor
+template<class E>
+constexpr int lazy_size(int i)
+{
+    if constexpr ( E::ndim() == 0 ) { return 1; }
+    else if(i == 0) { return E::size0(); }
+    else { return lazy_size<decltype(std::declval<E const&>()[0])>(i - 1); }
+}
+
+
+template<class Tensor>
+struct lazy_leaf
+{
+    using element_type = typename Tensor::element_type;
+
+    Tensor const* m_ref;
+
+    static constexpr int ndim() { return Tensor::ndim(); }
+    static constexpr int size0() { return Tensor::size(0); }
+    static constexpr int size(int i) { return Tensor::size(i); }
+
+    auto operator[](int i) const
+    {
+        using sub = std::remove_cvref_t<decltype((*m_ref)[i])>;
+        return lazy_leaf<sub> { &(*m_ref)[i] };
+    }
+    element_type item() const { return m_ref->item(); }
+};
+
+// views are held by value, their subviews are temporaries
+template<class View>
+struct lazy_view
+{
+    using element_type = typename View::element_type;
+
+    View m_view;
+
+    static constexpr int ndim() { return View::ndim(); }
+    static constexpr int size0() { return View::size(0); }
+    static constexpr int size(int i) { return View::size(i); }
+
+    auto operator[](int i) const { return lazy_view<decltype(m_view[i])> { m_view[i] }; }
+    element_type item() const { return m_view.item(); }
+};
+
+template<class T>
+struct lazy_scalar
+{
+    using element_type = T;
+
+    T m_value;
+
+    static constexpr int ndim() { return 0; }
+
+    T item() const { return m_value; }
+};
+
+
+template<class F, class A>
+struct lazy_unary
+{
+    A a;
+
+    static constexpr int ndim() { return A::ndim(); }
+    static constexpr int size0() { return A::size0(); }
+    static constexpr int size(int i) { return lazy_size<lazy_unary>(i); }
+
+    auto operator[](int i) const { return lazy_unary<F, decltype(a[i])> { a[i] }; }
+    auto item() const { return F{}(a.item()); }
+
+    using element_type = decltype(F{}(std::declval<typename A::element_type>()));
+};
+
+
+template<class F, class A, class B>
+struct lazy_binary
+{
+    A a;
+    B b;
+
+    static constexpr int ndim() { return std::max(A::ndim(), B::ndim()); }
+    static constexpr int size0()
+    {
+        if constexpr ( A::ndim() > B::ndim() ) { return A::size0(); }
+        else if constexpr ( A::ndim() < B::ndim() ) { return B::size0(); }
+        else { return std::max(A::size0(), B::size0()); }
+    }
+    static constexpr int size(int i) { return lazy_size<lazy_binary>(i); }
+
+    // same numpy broadcasting rules as broadcast()
+    auto operator[](int i) const
+    {
+        if constexpr ( A::ndim() > B::ndim() )
+        {
+            return lazy_binary<F, decltype(a[i]), B> { a[i], b };
+        }
+        else if constexpr ( A::ndim() < B::ndim() )
+        {
+            return lazy_binary<F, A, decltype(b[i])> { a, b[i] };
+        }
+        else
+        {
+            constexpr int A0 = A::size0();
+            constexpr int B0 = B::size0();
+            static_assert(A0==B0 || A0==1 || B0==1, "broadcast mismatch dim");
+            return lazy_binary<F, decltype(a[0]), decltype(b[0])> {
+                a[A0>1 ? i : 0], b[B0>1 ? i : 0] };
+        }
+    }
+    auto item() const { return F{}(a.item(), b.item()); }
+
+    using element_type = decltype(F{}(
+        std::declval<typename A::element_type>(),
+        std::declval<typename B::element_type>()));
+};
+
+
+template<lazy_ref E>
+auto as_lazy(E const& e) { return e; }
+
+template<tensor_ref Ta>
+requires (!view_ref<Ta>)
+auto as_lazy(Ta const& a) { return lazy_leaf<std::remove_cvref_t<Ta>> { &a }; }
+
+template<view_ref V>
+auto as_lazy(V const& v) { return lazy_view<std::remove_cvref_t<V>> { v }; }
+
+template<scalar_ref T>
+auto as_lazy(T a) { return lazy_scalar<std::remove_cvref_t<T>> { a }; }
+
+
+// entry point, scalars stay scalars so generic code works on both
+template<tensor_arg Ta>
+auto lazy(Ta const& a)
+{
+    if constexpr ( scalar_ref<Ta> ) { return a; }
+    else { return as_lazy(a); }
+}
+
+
+template<class E>
+struct lazy_eval_helper
+{
+    using sub = typename lazy_eval_helper<decltype(std::declval<E const&>()[0])>::type;
+    using type = stack_t<E::size0(), sub>;
+};
+
+template<class E>
+requires (E::ndim() == 0)
+struct lazy_eval_helper<E>
+{
+    using type = tensor<typename E::element_type>;
+};
+
+template<class E>
+using lazy_eval_t = typename lazy_eval_helper<std::remove_cvref_t<E>>::type;
+
+
+// materialize an expression, anything else passes through
+template<class E>
+decltype(auto) eval(E && e)
+{
+    if constexpr ( lazy_ref<E> ) { return lazy_eval_t<E>(e); }
+    else { return std::forward<E>(e); }
+}
+
+
+template<class F, class A>
+auto lazy_map(A const& a)
+{
+    auto la = as_lazy(a);
+    return lazy_unary<F, decltype(la)> { la };
+}
+
+template<class F, class A, class B>
+auto lazy_map(A const& a, B const& b)
+{
+    auto la = as_lazy(a);
+    auto lb = as_lazy(b);
+    return lazy_binary<F, decltype(la), decltype(lb)> { la, lb };
+}
+
+
+struct lazy_neg { auto operator()(auto a) const { return -a; } };
+struct lazy_add { auto operator()(auto a, auto b) const { return a + b; } };
+struct lazy_sub { auto operator()(auto a, auto b) const { return a - b; } };
+struct lazy_mul { auto operator()(auto a, auto b) const { return a * b; } };
+struct lazy_div { auto operator()(auto a, auto b) const { return a / b; } };
+
+struct lazy_exp { auto operator()(auto a) const { return math_exp(a); } };
+struct lazy_log { auto operator()(auto a) const { return math_log(a); } };
+struct lazy_sigmoid { auto operator()(auto a) const { return math_sigmoid(a); } };
+struct lazy_tanh { auto operator()(auto a) const { return math_tanh(a); } };
+struct lazy_sqrt { auto operator()(auto a) const { return std::sqrt(a); } };
+
+
+template<lazy_ref E>
+auto operator-(E const& a) { return lazy_map<lazy_neg>(a); }
+
+template<tensor_arg Ta, tensor_arg Tb>
+requires lazy_ref<Ta> || lazy_ref<Tb>
+auto operator+(Ta const& a, Tb const& b) { return lazy_map<lazy_add>(a, b); }
+
+template<tensor_arg Ta, tensor_arg Tb>
+requires lazy_ref<Ta> || lazy_ref<Tb>
+auto operator-(Ta const& a, Tb const& b) { return lazy_map<lazy_sub>(a, b); }
+
+template<tensor_arg Ta, tensor_arg Tb>
+requires lazy_ref<Ta> || lazy_ref<Tb>
+auto operator*(Ta const& a, Tb const& b) { return lazy_map<lazy_mul>(a, b); }
+
+template<tensor_arg Ta, tensor_arg Tb>
+requires lazy_ref<Ta> || lazy_ref<Tb>
+auto operator/(Ta const& a, Tb const& b) { return lazy_map<lazy_div>(a, b); }
+
+template<lazy_ref E>
+auto exp(E const& a) { return lazy_map<lazy_exp>(a); }
+
+template<lazy_ref E>
+auto log(E const& a) { return lazy_map<lazy_log>(a); }
+
+template<lazy_ref E>
+auto sigmoid(E const& a) { return lazy_map<lazy_sigmoid>(a); }
+
+template<lazy_ref E>
+auto tanh(E const& a) { return lazy_map<lazy_tanh>(a); }
+
+template<lazy_ref E>
+auto sqrt(E const& a) { return lazy_map<lazy_sqrt>(a); }
+
+
+} // namespace gaii
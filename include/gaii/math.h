@@ -2,6 +2,7 @@
 
 #include "gaii/var.h"
 #include "gaii/op.h"
+#include "gaii/lazy.h"
 
 #include <cmath>
 
@@ -24,7 +25,7 @@ auto operator-(A && a)
     return [] (A a) -> unary_op<A> {
         var y {-value(a)};
         co_yield y;
-        backward(a, -y.grad);
+        backward(a, -lazy(y.grad));
     }(fwd<A>(a));
 }
 
@@ -49,7 +50,7 @@ auto operator-(A && a, B && b)
         co_yield y;
         // std::cout << "op-:b " << y.grad << std::endl;
         backward(a, y.grad);
-        backward(b, -y.grad);
+        backward(b, -lazy(y.grad));
     }(fwd<A>(a), fwd<B>(b));
 }
 
@@ -60,8 +61,8 @@ auto operator*(A && a, B && b)
     return [] (A a, B b) -> binary_op<A, B> {
         var y {value(a) * value(b)};
         co_yield y;
-        backward(a, value(b) * y.grad);
-        backward(b, value(a) * y.grad);
+        backward(a, lazy(value(b)) * y.grad);
+        backward(b, lazy(value(a)) * y.grad);
     }(fwd<A>(a), fwd<B>(b));
 }
 
@@ -84,7 +85,7 @@ auto exp(A && a)
         using std::exp;
         var y {exp(value(a))};
         co_yield y;
-        backward(a, y.grad * y.value);
+        backward(a, lazy(y.grad) * y.value);
     }(fwd<A>(a));
 }
 
@@ -95,7 +96,7 @@ auto tanh(A && a)
         using std::tanh;
         var y {tanh(value(a))};
         co_yield y;
-        backward(a, y.grad * y.value * (1 - y.value));
+        backward(a, lazy(y.grad) * (1 - lazy(y.value) * y.value));
     }(fwd<A>(a));
 }
 
@@ -105,25 +106,53 @@ auto sigmoid(A && a)
     return [] (A a) -> unary_op<A> {
         var y {sigmoid(value(a))};
         co_yield y;
-        backward(a, y.grad * (1 - y.value * y.value));
+        backward(a, lazy(y.grad) * y.value * (1 - lazy(y.value)));
     }(fwd<A>(a));
 }
 
+// same elements in a new shape, copied, and the gradient comes back in the old one
+template<int... N, diffable A>
+auto reshape(A && a)
+{
+    using X = std::remove_cvref_t<decltype(value(a))>;
+    using Y = auto_tensor_t<element_type<X>, N...>;
+    return [] (A a) -> op<var<Y>> {
+        var<Y> y;
+        y.value = reshape<N...>(value(a));
+        co_yield y;
+        backward(a, view_as<X>(y.grad.raw()));
+    }(fwd<A>(a));
+}
 
 
 
+// rows of a table picked by index, instead of onehot % table
+// backward scatters into the picked rows only
+template<diffable A, int B>
+auto embedding(A && table, tensor<int, B> const& index)
+{
+    using Row = typename std::remove_cvref_t<decltype(value(table))>::subtensor;
+    return [] (A a, tensor<int, B> index) -> op<var<stack_t<B, Row>>> {
+        var<stack_t<B, Row>> y;
+        for(int b=0 ; b<B ; b++) { y.value[b] = value(a)[index(b)]; }
+        co_yield y;
+        for(int b=0 ; b<B ; b++) { backward_row(a, index(b), y.grad[b]); }
+    }(fwd<A>(table), index);
+}
+
+// over the last dim, which is kept with size 1
 template<diffable A>
 auto logsumexp(A && a)
 {
-    return [] (A a) -> op<var<decltype(logsumexp(value(a)))>> {
+    return [] (A a) -> op<var<decltype(max_last(value(a)))>> {
         auto & x = value(a);
-        auto xmax = broadcast<1>(x, [] (auto & xi) { return max(xi); });
-        auto xexp = exp(x - xmax);
-        auto sumexp = broadcast<1>(xexp, [] (auto & xi) { return sum(xi); });
-        var y {log(sumexp) + xmax};
+        auto xmax = max_last(x);
+        auto xexp = exp(eval(lazy(x) - xmax));
+        auto sumexp = sum_last(xexp);
+        var y {eval(lazy(log(sumexp)) + xmax)};
         co_yield y;
         // std::cout << "logsumexp:b " << y.grad << std::endl;
-        backward(a, y.grad * xexp / sumexp);
+        backward(a, lazy(y.grad) * xexp / sumexp);
     }(fwd<A>(a));
 }
 
@@ -141,4 +170,39 @@ auto log_softmax(A && a)
 
 
 
+// -log_softmax(logits)[index] for each row of logits[B, V]
+// only the row logsumexp is kept, backward recomputes softmax - onehot
+// from the logits in one pass
+template<diffable A, int B>
+auto cross_entropy(A && logits, tensor<int, B> const& index)
+{
+    using Logits = std::remove_cvref_t<decltype(value(logits))>;
+    using T = element_type<Logits>;
+    static_assert(Logits::ndim() == 2 && Logits::size(0) == B, "logits must be [B, V]");
+
+    return [] (A a, tensor<int, B> index) -> op<var<tensor<T, B>>> {
+        auto & x = value(a);
+        tensor<T, B> lse;
+        var<tensor<T, B>> y;
+        for(int b=0 ; b<B ; b++)
+        {
+            T mx = max(x[b]);
+            T sumexp = sum(exp(eval(lazy(x[b]) - mx)));
+            lse(b) = std::log(sumexp) + mx;
+            y.value(b) = lse(b) - x(b, index(b));
+        }
+        co_yield y;
+        for(int b=0 ; b<B ; b++)
+        {
+            T g = y.grad(b);
+            typename Logits::subtensor dx = exp(eval(lazy(x[b]) - lse(b)));
+            dx *= g;
+            dx(index(b)) -= g;
+            backward_row(a, b, dx);
+        }
+    }(fwd<A>(logits), index);
+}
+
+
+
 } // namespace gaii
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "gaii/var.h"
+#include "gaii/arena.h"
 
 #include <exception>
 
+#ifdef GAII_PROFILE
+#include "gaii/profile.h"
+#endif
+
 #if __has_include(<coroutine>)
 #include <coroutine>
 #define GAII_COROTINE_NAMESPACE std
@@ -27,8 +32,26 @@ struct promise
 
     T * m_value = nullptr;
 
+#ifdef GAII_PROFILE
+    op_profile m_profile;
+
+    // the default argument is evaluated in the coroutine, naming it
+    promise(std::source_location loc = std::source_location::current())
+    :   m_profile(loc)
+    {}
+
+    static void * operator new(std::size_t n)
+    {
+        this_thread_profile().frame_bytes = n;
+        return allocate_frame(n);
+    }
+#else
     promise() = default;
 
+    static void * operator new(std::size_t n) { return allocate_frame(n); }
+#endif
+    static void operator delete(void * p, std::size_t n) noexcept { deallocate_frame(p, n); }
+
     op<T> get_return_object() noexcept
     {
         return { coro_handle::from_promise(*this) };
@@ -40,6 +63,9 @@ struct promise
     suspend_always yield_value(T & value) noexcept
     {
         m_value = std::addressof(value);
+#ifdef GAII_PROFILE
+        m_profile.yielded();
+#endif
         return {};
     }
     suspend_always yield_value(T && value) noexcept { return yield_value(value); }
@@ -70,7 +96,7 @@ struct op
     :   m_coroutine(coroutine)
     {}
     op(op const& o) = delete;
-    op(op && o)
+    op(op && o) noexcept
     :   m_coroutine(o.m_coroutine)
     {
         o.m_coroutine = nullptr;
@@ -80,7 +106,13 @@ struct op
     {
         if(m_coroutine)
         {
+#ifdef GAII_PROFILE
+            m_coroutine.promise().m_profile.begin_backward();
             m_coroutine.resume();
+            m_coroutine.promise().m_profile.end_backward();
+#else
+            m_coroutine.resume();
+#endif
             m_coroutine.destroy();
         }
     }
@@ -93,6 +125,7 @@ struct op
     auto & get_value() const { return get().get_value(); }
     auto & get_grad() const { return get().get_grad(); }
     void backward(auto && grad) { get().backward(grad); }
+    void backward_row(int i, auto && grad) { get().backward_row(i, grad); }
 }; // struct op
 
 
@@ -1,81 +1,339 @@
 #pragma once
 
+#include "gaii/var.h"
+#include "gaii/grads.h"
+#include "gaii/simd.h"
+
+#include <array>
+#include <cmath>
+#include <vector>
+
 namespace gaii {
 namespace optim {
 
 
+// by default each param updates in backward, the first time it is touched in a step
+// with deferred, gradients add up in one flat buffer instead, and step() updates
+// every param in one fused pass over it. update(begin, end) is the same pass over
+// a slice of the buffer, so threads can each take a shard
+//
+// kernel() is the fused per-element update: param, grad and optimizer state are
+// each read once and written once, W lanes at a time, and the grad is zeroed
+//
+// params may be bf16 or fp16 tensors, which are updated through fp32 master
+// weights (gaii/grads.h), with optimizer state and gradients in fp32 as well.
+// gradients are divided by loss.scale before anything else, and with
+// loss.dynamic a step with any overflowed gradient is skipped whole
+//
+// optimizer state is flat and indexed like the grads in either mode, so it
+// can be saved with the weights (gaii/weights.h)
+
+
+template<class S>
+auto clamp_abs(typename S::reg x, float limit)
+{
+    return S::min(S::max(x, S::set1(-limit)), S::set1(limit));
+}
+
+
+// sgd with optional momentum, nesterov looks ahead along the velocity
 struct sgd
 {
     float lr = 0.0003;
+    float momentum = 0;
+    bool nesterov = false;
     float grad_clamp = 1;
     float param_clamp = 5;
-    int step = 0;
+    int steps = 0;
+    bool deferred = false;
+    loss_scale loss {};
+    param_registry params {};
+    std::vector<float> velocity {}; // flat, indexed like the grads
+
+    // what save_weights keeps to resume training
+    auto state() { return std::array{ &velocity }; }
+
+    int add(auto & p)
+    {
+        int offset = params.add(p);
+        velocity.resize(params.size(), 0);
+        return offset;
+    }
+
+    template<bool Momentum, bool Nesterov>
+    void fused(float * v, float * g, float * vel, int n) const
+    {
+        float unscale = 1 / loss.scale;
+        simd_loop<float>(n, [&] <class S> (int i) {
+            auto d = clamp_abs<S>(S::mul(S::load(g + i), S::set1(unscale)), grad_clamp);
+            if constexpr ( Momentum )
+            {
+                auto m = S::fmadd(S::set1(momentum), S::load(vel + i), d);
+                S::store(vel + i, m);
+                if constexpr ( Nesterov ) { d = S::fmadd(S::set1(momentum), m, d); }
+                else { d = m; }
+            }
+            auto vi = S::fmadd(S::set1(-lr), d, S::load(v + i));
+            S::store(v + i, clamp_abs<S>(vi, param_clamp));
+            S::store(g + i, S::zero());
+        });
+    }
+
+    void kernel(float * v, float * g, float * vel, int n) const
+    {
+        if(momentum == 0) { fused<false, false>(v, g, vel, n); }
+        else if(nesterov) { fused<true, true>(v, g, vel, n); }
+        else { fused<true, false>(v, g, vel, n); }
+    }
+
+    // dynamic loss scaling needs every gradient of the step before any update
+    bool deferring() const { return deferred || loss.dynamic; }
+
+    // after loss.check over the whole step
+    void update(int begin, int end)
+    {
+        if(loss.skipping())
+        {
+            std::fill(params.grad.begin() + begin, params.grad.begin() + end, 0.f);
+            return;
+        }
+        params.each_range(begin, end, [&] (float * v, int offset, int n) {
+            kernel(v, params.grad.data() + offset, velocity.data() + offset, n);
+        });
+    }
+
+    // after every update in a step
+    void end_step()
+    {
+        loss.end_step();
+        steps ++;
+    }
+
+    void step()
+    {
+        loss.check(params.grad.data(), params.size());
+        update(0, params.size());
+        end_step();
+    }
 
     template<class T>
     struct param : var<T>
     {
+        using F = float_tensor_t<T>;
+
         sgd & opt;
+        master_weights<T> master;
         int step = 0;
+        int offset;
+
+        param(var<T> init, sgd & opt)
+        :   var<T>(std::move(init)), opt(opt), master(this->value), offset(opt.add(*this))
+        {}
+        param(param const&) = delete;
+
+        void update(auto && grad)
+        {
+            // reduces broadcast dims, and evaluates lazy grads
+            F gi = 0;
+            gi += grad;
+            opt.kernel(master.raw(this->value), gi.raw(), opt.velocity.data() + offset, T::size());
+            master.round(this->value, 0, T::size());
+            step = opt.steps;
+        }
 
         void backward(auto && grad)
         {
-            auto & g = this->grad;
-            if(step != opt.step)
+            if(float * g = opt.params.grad_sink(opt.deferring()))
             {
-                clamp_inplace(grad, -opt.grad_clamp, opt.grad_clamp);
-                this->value -= opt.lr * grad;
-                clamp_inplace(this->value, -opt.param_clamp, opt.param_clamp);
-                step = opt.step;
+                view_as<T>(g + offset) += grad;
+                return;
             }
-            g += grad;
+            if(step != opt.steps) { update(grad); }
+            this->grad += grad;
+        }
+
+        // sparse rows update on their first touch in a step, as whole params do
+        std::vector<int> row_steps;
+
+        void backward_row(int i, auto && grad)
+        {
+            if(float * g = opt.params.grad_sink(opt.deferring()))
+            {
+                view_as<T>(g + offset)[i] += grad;
+                return;
+            }
+            row_steps.resize(T::size(0), 0);
+            if(row_steps[i] != opt.steps)
+            {
+                using Row = typename F::subtensor;
+                Row gi = 0;
+                gi += grad;
+                int at = i * Row::size();
+                opt.kernel(master.raw(this->value) + at, gi.raw(), opt.velocity.data() + offset + at, Row::size());
+                master.round(this->value, at, Row::size());
+                row_steps[i] = opt.steps;
+            }
+            this->grad[i] += grad;
         }
     };
 };
 
-struct adam
+
+// adam with bias corrected moments
+// weight_decay is L2 on the gradient, or decoupled from it for adamw
+template<bool Decoupled>
+struct adam_t
 {
     float lr = 0.001;
     float beta1 = 0.9;
     float beta2 = 0.999;
     float eps = 1e-8;
+    float weight_decay = Decoupled ? 0.01 : 0;
     float grad_clamp = 1;
     float param_clamp = 5;
-    int m1mass = 1 / (1 - beta1);
-    int m2mass = 1 / (1 - beta2);
-    int step = 0;
-    
+    int steps = 0;
+    bool deferred = false;
+    loss_scale loss {};
+    param_registry params {};
+    std::vector<float> m1 {}; // flat moments, indexed like the grads
+    std::vector<float> m2 {};
+
+    auto state() { return std::array{ &m1, &m2 }; }
+
+    int add(auto & p)
+    {
+        int offset = params.add(p);
+        m1.resize(params.size(), 0);
+        m2.resize(params.size(), 0);
+        return offset;
+    }
+
+    // t counts steps from 1
+    void kernel(float * v, float * g, float * a, float * b, int n, int t) const
+    {
+        float c1 = 1 / (1 - std::pow(beta1, t));
+        float c2 = 1 / (1 - std::pow(beta2, t));
+        float decay = Decoupled ? 1 - lr * weight_decay : 1;
+        float l2 = Decoupled ? 0 : weight_decay;
+        float unscale = 1 / loss.scale;
+
+        simd_loop<float>(n, [&] <class S> (int i) {
+            auto vi = S::load(v + i);
+            auto gi = clamp_abs<S>(S::mul(S::load(g + i), S::set1(unscale)), grad_clamp);
+            if constexpr ( !Decoupled ) { gi = S::fmadd(S::set1(l2), vi, gi); }
+            if constexpr ( Decoupled ) { vi = S::mul(S::set1(decay), vi); }
+
+            auto ai = S::fmadd(S::set1(beta1), S::load(a + i), S::mul(S::set1(1 - beta1), gi));
+            auto bi = S::fmadd(S::set1(beta2), S::load(b + i), S::mul(S::set1(1 - beta2), S::mul(gi, gi)));
+            auto denom = S::add(S::sqrt(S::mul(S::set1(c2), bi)), S::set1(eps));
+            vi = S::sub(vi, S::div(S::mul(S::set1(lr * c1), ai), denom));
+
+            S::store(a + i, ai);
+            S::store(b + i, bi);
+            S::store(v + i, clamp_abs<S>(vi, param_clamp));
+            S::store(g + i, S::zero());
+        });
+    }
+
+    // dynamic loss scaling needs every gradient of the step before any update
+    bool deferring() const { return deferred || loss.dynamic; }
+
+    // after loss.check over the whole step
+    void update(int begin, int end)
+    {
+        if(loss.skipping())
+        {
+            std::fill(params.grad.begin() + begin, params.grad.begin() + end, 0.f);
+            return;
+        }
+        params.each_range(begin, end, [&] (float * v, int offset, int n) {
+            kernel(v, params.grad.data() + offset,
+                m1.data() + offset, m2.data() + offset, n, steps + 1);
+        });
+    }
+
+    // after every update in a step
+    void end_step()
+    {
+        loss.end_step();
+        steps ++;
+    }
+
+    void step()
+    {
+        loss.check(params.grad.data(), params.size());
+        update(0, params.size());
+        end_step();
+    }
+
     template<class T>
     struct param : var<T>
     {
-        adam & opt;
-        T m1 = 0;
-        T m2 = 0;
+        using F = float_tensor_t<T>;
+
+        adam_t & opt;
+        master_weights<T> master;
         int step = 0;
+        int offset;
 
-        void backward(auto && grad)
+        param(var<T> init, adam_t & opt)
+        :   var<T>(std::move(init)), opt(opt), master(this->value), offset(opt.add(*this))
+        {}
+        param(param const&) = delete;
+
+        void update(auto && grad)
         {
-            auto & g = this->grad;
+            F gi = 0;
+            gi += grad;
+            opt.kernel(master.raw(this->value), gi.raw(),
+                opt.m1.data() + offset, opt.m2.data() + offset, T::size(), opt.steps + 1);
+            master.round(this->value, 0, T::size());
+            step = opt.steps;
+        }
 
-            if(step != opt.step)
+        void backward(auto && grad)
+        {
+            if(float * g = opt.params.grad_sink(opt.deferring()))
             {
-                clamp_inplace(g, -opt.grad_clamp, opt.grad_clamp);
-
-                m1 += (g - m1) / std::min(opt.m1mass, step);
-                m2 += (g*g - m2) / std::min(opt.m2mass, step);
-
-                this->value -= opt.lr * m1 / (sqrt(m2) + opt.eps);
+                view_as<T>(g + offset) += grad;
+                return;
+            }
+            if(step != opt.steps) { update(grad); }
+            this->grad += grad;
+        }
 
-                clamp_inplace(this->value, -opt.param_clamp, opt.param_clamp);
+        // sparse rows update on their first touch in a step, as whole params do,
+        // so only the moments of used rows move, and once per step
+        std::vector<int> row_steps;
 
-                step = opt.step;
+        void backward_row(int i, auto && grad)
+        {
+            if(float * g = opt.params.grad_sink(opt.deferring()))
+            {
+                view_as<T>(g + offset)[i] += grad;
+                return;
             }
-
-            g += grad;
+            row_steps.resize(T::size(0), 0);
+            if(row_steps[i] != opt.steps)
+            {
+                using Row = typename F::subtensor;
+                Row gi = 0;
+                gi += grad;
+                int at = i * Row::size();
+                opt.kernel(master.raw(this->value) + at, gi.raw(),
+                    opt.m1.data() + offset + at, opt.m2.data() + offset + at, Row::size(), opt.steps + 1);
+                master.round(this->value, at, Row::size());
+                row_steps[i] = opt.steps;
+            }
+            this->grad[i] += grad;
         }
     };
 };
 
+using adam = adam_t<false>;
+using adamw = adam_t<true>;
+
 
 
 } // namespace optim
-} // namespace gaii
\ No newline at end of file
+} // namespace gaii
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "gaii/grads.h"
+#include "gaii/pool.h"
+
+#include <barrier>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace gaii {
+
+
+// data parallel training over worker threads
+//
+//   data_parallel dp { .opt = opt, .workers = 8 };
+//   dp.run(steps, [&] (int worker, int step) { ...forward and backward... });
+//
+// params are only read while workers run, and each worker's backward lands
+// in its own grad_buffer. the buffers are summed into the optimizer's flat
+// grad, then each worker updates its own slice of the params with
+// opt.update(begin, end), so every worker sees the same weights at every step
+//
+// deterministic sums each gradient element in worker order, with each worker
+// summing its own slice of the buffer, so a run is reproducible for a given
+// worker count. otherwise workers add into the sum as they finish, which
+// overlaps the reduction with slower workers but varies the rounding
+//
+// with more than one worker, their ops don't use the intra-op pool
+// each worker caches its freed heap tensor buffers for the run (gaii/tensor.h)
+template<class Optimizer>
+struct data_parallel
+{
+    Optimizer & opt;
+    int workers = 1;
+    bool deterministic = true;
+
+    template<class F>
+    void run(int steps, F && fn)
+    {
+        param_registry & params = opt.params;
+        std::vector<grad_buffer> grads(workers, grad_buffer(params));
+        std::barrier sync(workers);
+        std::barrier done(workers, [&] () noexcept { opt.end_step(); });
+        std::mutex sum_lock;
+
+        auto work = [&] (int w) {
+            grad_buffer_scope scope(grads[w]);
+            heap_cache_scope cache;
+            std::optional<serial_scope> serial;
+            if(workers > 1) { serial.emplace(); }
+            int n = params.size();
+            int begin = long(n) * w / workers;
+            int end = long(n) * (w + 1) / workers;
+
+            for(int s=0 ; s<steps ; s++)
+            {
+                grads[w].zero();
+                fn(w, s);
+
+                if(deterministic)
+                {
+                    sync.arrive_and_wait();
+                    for(int i=begin ; i<end ; i++)
+                    {
+                        float acc = 0;
+                        for(auto & g : grads) { acc += g.data[i]; }
+                        params.grad[i] += acc;
+                    }
+                }
+                else
+                {
+                    std::lock_guard lock(sum_lock);
+                    for(int i=0 ; i<n ; i++) { params.grad[i] += grads[w].data[i]; }
+                }
+                sync.arrive_and_wait();
+
+                // with dynamic loss scaling, an overflow in any shard skips every shard
+                if(opt.loss.dynamic)
+                {
+                    opt.loss.check(params.grad.data() + begin, end - begin);
+                    sync.arrive_and_wait();
+                }
+
+                // the optimizer step is sharded the same way
+                opt.update(begin, end);
+                done.arrive_and_wait();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for(int w=1 ; w<workers ; w++) { threads.emplace_back(work, w); }
+        work(0);
+        for(auto & t : threads) { t.join(); }
+    }
+};
+
+
+} // namespace gaii
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "gaii/bptt.h"
+#include "gaii/grads.h"
+#include "gaii/pool.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace gaii {
+
+
+// bounded single producer, single consumer ring
+// lock free until it is full or empty, then it sleeps on the index it waits for
+template<class T>
+struct spsc_queue
+{
+    std::vector<T> ring;
+    alignas(64) std::atomic<unsigned> head = 0; // next to pop
+    alignas(64) std::atomic<unsigned> tail = 0; // next to push
+
+    spsc_queue(int capacity) : ring(capacity) {}
+
+    void push(T v)
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        unsigned h;
+        while(t - (h = head.load(std::memory_order_acquire)) == ring.size())
+        {
+            head.wait(h, std::memory_order_acquire);
+        }
+        ring[t % ring.size()] = v;
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+
+    T pop()
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        unsigned t;
+        while((t = tail.load(std::memory_order_acquire)) == h)
+        {
+            tail.wait(t, std::memory_order_acquire);
+        }
+        T v = ring[h % ring.size()];
+        head.store(h + 1, std::memory_order_release);
+        head.notify_one();
+        return v;
+    }
+};
+
+
+// stacked recurrent layers, each on a thread of its own, with time steps
+// streaming through them
+//
+//   rnn_pipeline<op<Layer>> pipe { layers, T, [&] (int l, auto & x, auto & h) { return model.layer(l, x, h); } };
+//   pipe.forward(T, [&] (int t) -> auto & { ...input var of step t... },
+//                   [&] (int t, auto & y) { ...output y of step t, to the loss... });
+//   pipe.backward([&] (int t) { ...unwind what forward made from y at t... },
+//                 [&] (int t) { ...unwind what made the input at t... });
+//
+// layer l at step t needs only layer l-1 at t and layer l at t-1, so layer
+// l-1 can be on t+1 while layer l is on t. each layer keeps its step ops in
+// a bptt ring on its own thread and sends its outputs up through a queue,
+// so with d layers a chunk takes about T + d steps of the slowest layer
+// instead of T * d. backward goes back down the same way, newest step first:
+// a layer unwinds step t once the layer above has unwound its step t
+//
+// Layer has out, the next layer's input, and h, the state for its next step.
+// each layer reads a copy of the output below, which collects its gradient,
+// and the copy's gradient is added back on the thread that owns the output,
+// so no two threads write one var. the chunk's last states carry over to the
+// next chunk, and gradients go to the caller's grad_buffer, if it has one.
+// forward and backward take turns, and both run on the same thread
+template<class Step>
+struct rnn_pipeline
+{
+    using Layer = std::remove_reference_t<decltype(*std::declval<Step &>())>;
+    using X = std::remove_reference_t<decltype(std::declval<Layer &>().out)>;
+    using H = std::remove_reference_t<decltype(std::declval<Layer &>().h)>;
+
+    struct layer
+    {
+        bptt<Step> steps;
+        std::vector<X> inputs;  // copies of the outputs below
+        H init {};              // state before the chunk's first step
+        spsc_queue<X *> up;     // outputs from below, null at the end of the chunk
+        spsc_queue<int> down;   // steps whose outputs have all their gradient, from above
+        std::thread thread;
+
+        layer(int capacity)
+        :   steps(capacity), inputs(capacity), up(capacity + 1), down(capacity)
+        {}
+    };
+
+    std::function<Step(int, X &, H &)> stage;
+    std::deque<layer> layers;
+    std::vector<X *> sources;   // the caller's inputs
+    std::vector<X> outputs;     // copies of the last layer's outputs, for the caller
+    spsc_queue<int> out;        // last layer to the caller, step t is out
+    spsc_queue<int> done;       // first layer to the caller, step t is unwound
+    grad_buffer * grads = nullptr;
+    bool stopping = false;
+    int steps = 0;
+
+    rnn_pipeline(int depth, int capacity, std::function<Step(int, X &, H &)> stage, bool pin = false)
+    :   stage(std::move(stage)), sources(capacity), outputs(capacity), out(capacity), done(capacity)
+    {
+        for(int l=0 ; l<depth ; l++) { layers.emplace_back(capacity); }
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        for(int l=0 ; l<depth ; l++)
+        {
+            layers[l].thread = std::thread([this, l] { run(l); });
+            if(pin)
+            {
+                // the caller keeps core 0
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET((l + 1) % cores, &set);
+                pthread_setaffinity_np(layers[l].thread.native_handle(), sizeof(set), &set);
+            }
+        }
+    }
+    rnn_pipeline(rnn_pipeline const&) = delete;
+
+    // after backward, if forward ran
+    ~rnn_pipeline()
+    {
+        stopping = true;
+        for(auto & l : layers) { l.up.push(nullptr); }
+        for(auto & l : layers) { l.thread.join(); }
+    }
+
+    int depth() const { return layers.size(); }
+
+    // head(t) is the input var of step t, tail(t, y) gets the output of step t
+    template<class Head, class Tail>
+    void forward(int n, Head && head, Tail && tail)
+    {
+        assert(n <= int(sources.size()));
+        steps = n;
+        grads = thread_grads();
+        for(int t=0 ; t<n ; t++)
+        {
+            sources[t] = &head(t);
+            layers[0].up.push(sources[t]);
+        }
+        layers[0].up.push(nullptr);
+        for(int t=0 ; t<n ; t++)
+        {
+            out.pop();
+            tail(t, outputs[t]);
+        }
+    }
+
+    // unwind(t) undoes tail(t, ...), then unwind_head(t) undoes head(t), newest first
+    template<class Tail, class Head>
+    void backward(Tail && unwind, Head && unwind_head)
+    {
+        for(int t=steps-1 ; t>=0 ; t--)
+        {
+            unwind(t);
+            layers.back().down.push(t);
+        }
+        for(int t=steps-1 ; t>=0 ; t--)
+        {
+            done.pop();
+            sources[t]->backward(layers[0].inputs[t].grad);
+            unwind_head(t);
+        }
+        steps = 0;
+    }
+
+    void run(int l)
+    {
+        serial_scope serial;
+        layer & me = layers[l];
+        bool last = l + 1 == depth();
+        while(true)
+        {
+            // forward, until the end of the chunk
+            while(X * x = me.up.pop())
+            {
+                int t = me.steps.size();
+                me.inputs[t].value = x->value;
+                me.inputs[t].grad = 0;
+                H & h = me.steps.empty() ? me.init : me.steps.back()->h;
+                Layer & y = *me.steps.push(stage(l, me.inputs[t], h));
+                if(last)
+                {
+                    outputs[t].value = y.out.value;
+                    outputs[t].grad = 0;
+                    out.push(t);
+                }
+                else { layers[l+1].up.push(&y.out); }
+            }
+            if(stopping) { return; }
+            if(!last) { layers[l+1].up.push(nullptr); }
+            if(me.steps.empty()) { continue; }
+
+            // backward, newest first
+            std::optional<grad_buffer_scope> scope;
+            if(grads) { scope.emplace(*grads); }
+            auto h_last = me.steps.back()->h.value;
+            for(int t=me.steps.size()-1 ; t>=0 ; t--)
+            {
+                me.down.pop();
+                X & above = last ? outputs[t] : layers[l+1].inputs[t];
+                me.steps[t]->out.backward(above.grad);
+                me.steps.pop();
+                if(l == 0) { done.push(t); }
+                else { layers[l-1].down.push(t); }
+            }
+            me.init = { h_last };
+        }
+    }
+};
+
+
+} // namespace gaii
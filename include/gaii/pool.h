@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// default thread count of the intra-op pool, 0 for one per core, 1 for none
+#ifndef GAII_INTRA_OP_THREADS
+#define GAII_INTRA_OP_THREADS 0
+#endif
+
+// kernels with less work than this never look at the pool, whatever its threshold
+#ifndef GAII_INTRA_OP_MIN
+#define GAII_INTRA_OP_MIN (1 << 14)
+#endif
+
+namespace gaii {
+
+
+// threads shared by the kernels of one op, for shapes big enough to split
+//
+//   auto & pool = intra_op_pool();
+//   pool.resize(8);                  // threads including the caller, 1 turns it off
+//   pool.threshold = 1 << 16;        // elements of a broadcast before its outer loop splits
+//   pool.gemm_threshold = 1 << 21;   // multiply-adds of a mat_mul before its rows split
+//
+// parallel_for(n, f) runs f(i) for each i in [0, n), cut into a few ranges per
+// thread. threads take the next range from a shared counter as they finish
+// one, so a slow range doesn't hold up the rest, and the caller takes ranges
+// too. one loop runs at a time: a loop started while the pool is busy, or
+// from inside a loop or a data parallel worker, runs serially on its own thread
+struct thread_pool
+{
+    std::size_t threshold = 1 << 16;
+    std::size_t gemm_threshold = 1 << 21;
+
+    struct job
+    {
+        void (*call)(void *, int);
+        void * body;
+        int ranges;
+        std::atomic<int> next = 0;
+        int users = 0; // workers inside, under lock
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex busy;   // held by the thread running a loop
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable left;
+    job * current = nullptr;
+    long generation = 0;
+    bool stop = false;
+
+    thread_pool(int threads) { resize(threads); }
+    thread_pool(thread_pool const&) = delete;
+    ~thread_pool() { resize(1); }
+
+    int size() const { return workers.size() + 1; }
+
+    // not while a loop is running
+    void resize(int threads)
+    {
+        {
+            std::lock_guard l(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for(auto & t : workers) { t.join(); }
+        workers.clear();
+        stop = false;
+        for(int t=1 ; t<threads ; t++) { workers.emplace_back([this] { work(); }); }
+    }
+
+    // set on pool threads, and by serial_scope
+    static bool & serial()
+    {
+        thread_local bool on = false;
+        return on;
+    }
+
+    template<class F>
+    void parallel_for(int n, F && f)
+    {
+        if(n < 2 || workers.empty() || serial() || !busy.try_lock())
+        {
+            for(int i=0 ; i<n ; i++) { f(i); }
+            return;
+        }
+        std::lock_guard hold(busy, std::adopt_lock);
+
+        int ranges = std::min(n, 4 * size());
+        auto body = [&] (int r) {
+            int end = long(n) * (r + 1) / ranges;
+            for(int i=long(n) * r / ranges ; i<end ; i++) { f(i); }
+        };
+        job j { [] (void * b, int r) { (*static_cast<decltype(body) *>(b))(r); }, &body, ranges };
+        {
+            std::lock_guard l(lock);
+            current = &j;
+            generation ++;
+        }
+        wake.notify_all();
+
+        serial() = true;
+        run(j);
+        serial() = false;
+
+        // workers that haven't picked the job up by now won't, wait out the rest
+        std::unique_lock l(lock);
+        current = nullptr;
+        left.wait(l, [&] { return j.users == 0; });
+    }
+
+    static void run(job & j)
+    {
+        for(int r ; (r = j.next++) < j.ranges ; ) { j.call(j.body, r); }
+    }
+
+    void work()
+    {
+        serial() = true;
+        std::unique_lock l(lock);
+        long seen = generation;
+        while(true)
+        {
+            wake.wait(l, [&] { return stop || (current && generation != seen); });
+            if(stop) { return; }
+            seen = generation;
+            job * j = current;
+            j->users ++;
+            l.unlock();
+            run(*j);
+            l.lock();
+            if(--j->users == 0) { left.notify_all(); }
+        }
+    }
+};
+
+
+inline thread_pool & intra_op_pool()
+{
+    static thread_pool pool(GAII_INTRA_OP_THREADS > 0
+        ? GAII_INTRA_OP_THREADS : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+// RAII: ops on this thread stay on it, for threads that are already one of many
+struct serial_scope
+{
+    bool m_prev;
+
+    serial_scope() : m_prev(thread_pool::serial()) { thread_pool::serial() = true; }
+    serial_scope(serial_scope const&) = delete;
+    ~serial_scope() { thread_pool::serial() = m_prev; }
+};
+
+
+// true if a loop of N over Work should go to the pool, against one of its thresholds
+template<std::size_t Work, int N>
+bool intra_op_split(std::size_t thread_pool::* threshold = &thread_pool::threshold)
+{
+    if constexpr ( Work < GAII_INTRA_OP_MIN || N < 2 ) { return false; }
+    else
+    {
+        thread_pool & pool = intra_op_pool();
+        return pool.size() > 1 && !thread_pool::serial() && Work >= pool.*threshold;
+    }
+}
+
+
+} // namespace gaii
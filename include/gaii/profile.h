@@ -0,0 +1,294 @@
+#pragma once
+
+#include <atomic>
+#include <ostream>
+
+#ifdef GAII_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <source_location>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#endif
+
+namespace gaii {
+
+
+// per op timing, compiled in with -DGAII_PROFILE and absent otherwise
+//
+// every op is keyed by the coroutine that made it, and records
+//   forward   construction to first yield
+//   backward  resume to final suspend
+//   the frame size and the number of calls
+// total time includes ops made or destroyed inside, self time does not
+// each op reads the clock four times, so tiny ops look slower than they are
+//
+//   gaii::profile_report(std::cout);       one line per op, all threads
+//   gaii::profile_tracing = true;          keep every span as well
+//   gaii::profile_trace(std::ofstream("trace.json"));  for chrome://tracing
+
+inline std::atomic<bool> profile_tracing = false;
+
+#ifdef GAII_PROFILE
+
+struct op_stats
+{
+    char const* function;
+    char const* file;
+    int line;
+    long calls = 0;
+    double frame_bytes = 0;
+    double forward_ns = 0;
+    double forward_self_ns = 0;
+    double backward_ns = 0;
+    double backward_self_ns = 0;
+};
+
+// one forward or backward, for the trace
+struct profile_span
+{
+    op_stats const* stats;
+    bool backward;
+    int64_t start_ns;
+    int64_t dur_ns;
+};
+
+// a timed region, regions nested inside it are taken out of its self time
+struct profile_region
+{
+    profile_region * parent = nullptr;
+    int64_t start = 0;
+    int64_t child = 0;
+};
+
+struct thread_profile
+{
+    int tid = 0;
+    std::unordered_map<char const*, op_stats> ops; // by function name, one per instantiation
+    std::vector<profile_span> spans;
+    profile_region * top = nullptr;
+    std::size_t frame_bytes = 0; // from operator new, for the promise built next
+};
+
+struct profile_registry
+{
+    std::mutex lock;
+    std::vector<thread_profile *> threads;
+};
+
+inline profile_registry & profile_threads()
+{
+    static profile_registry registry;
+    return registry;
+}
+
+// never freed, so a worker's numbers outlive the worker
+inline thread_profile & this_thread_profile()
+{
+    thread_local thread_profile * profile = [] {
+        auto & registry = profile_threads();
+        std::lock_guard lock(registry.lock);
+        auto * p = new thread_profile;
+        p->tid = registry.threads.size();
+        registry.threads.push_back(p);
+        return p;
+    }();
+    return *profile;
+}
+
+inline int64_t profile_now()
+{
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+// kept in each promise
+struct op_profile
+{
+    op_stats * stats;
+    profile_region region;
+    bool forward_done = false;
+
+    op_profile(std::source_location loc)
+    {
+        auto & t = this_thread_profile();
+        auto it = t.ops.try_emplace(loc.function_name(),
+            op_stats { loc.function_name(), loc.file_name(), int(loc.line()) }).first;
+        stats = &it->second;
+        stats->calls ++;
+        stats->frame_bytes += t.frame_bytes;
+        begin(t);
+    }
+
+    void begin(thread_profile & t)
+    {
+        region = { t.top, profile_now() };
+        t.top = &region;
+    }
+
+    void end(bool backward)
+    {
+        auto & t = this_thread_profile();
+        int64_t dur = profile_now() - region.start;
+        t.top = region.parent;
+        if(region.parent) { region.parent->child += dur; }
+        (backward ? stats->backward_ns : stats->forward_ns) += dur;
+        (backward ? stats->backward_self_ns : stats->forward_self_ns) += dur - region.child;
+        if(profile_tracing) { t.spans.push_back({ stats, backward, region.start, dur }); }
+    }
+
+    void yielded()
+    {
+        if(!forward_done) { forward_done = true; end(false); }
+    }
+    void begin_backward() { begin(this_thread_profile()); }
+    void end_backward() { end(true); }
+};
+
+
+// "gaii::op<...> Linear<...>::operator()(...) [with ...]" -> "Linear::operator()"
+// "gaii::exp<...>(A&&)::<lambda(A)>" -> "gaii::exp"
+inline std::string profile_name(std::string f)
+{
+    if(auto p = f.find(" [with ") ; p != std::string::npos) { f.resize(p); }
+    std::string out;
+    int depth = 0;
+    for(size_t i=0 ; i<f.size() ; i++)
+    {
+        // template args open after a name, "::<lambda" is not one
+        bool open = f[i] == '<' && i > 0 && f[i-1] != ':' && f[i-1] != ' ';
+        if(open || (depth && f[i] == '<')) { depth++; }
+        else if(depth && f[i] == '>') { depth--; }
+        else if(!depth) { out += f[i]; }
+    }
+    if(auto p = out.find("::<lambda") ; p != std::string::npos) { out.resize(p); }
+    if(!out.empty() && out.back() == ')')
+    {
+        int parens = 0;
+        for(size_t i=out.size() ; i-- > 0 ; )
+        {
+            parens += out[i] == ')';
+            parens -= out[i] == '(';
+            if(!parens) { out.resize(i); break; }
+        }
+    }
+    if(auto p = out.rfind(' ') ; p != std::string::npos) { out = out.substr(p + 1); }
+    return out;
+}
+
+inline std::string profile_site(op_stats const& s)
+{
+    std::string file = s.file;
+    if(auto p = file.find_last_of("/\\") ; p != std::string::npos) { file = file.substr(p + 1); }
+    return file + ":" + std::to_string(s.line);
+}
+
+// all threads, with instantiations of the same op summed
+inline void profile_report(std::ostream & out)
+{
+    std::map<std::string, op_stats> ops;
+    {
+        auto & registry = profile_threads();
+        std::lock_guard lock(registry.lock);
+        for(auto * t : registry.threads)
+            for(auto & [_, s] : t->ops)
+            {
+                auto [it, fresh] = ops.try_emplace(profile_name(s.function) + " " + profile_site(s), s);
+                if(fresh) { continue; }
+                auto & sum = it->second;
+                sum.calls += s.calls;
+                sum.frame_bytes += s.frame_bytes;
+                sum.forward_ns += s.forward_ns;
+                sum.forward_self_ns += s.forward_self_ns;
+                sum.backward_ns += s.backward_ns;
+                sum.backward_self_ns += s.backward_self_ns;
+            }
+    }
+
+    std::vector<std::pair<std::string, op_stats>> rows(ops.begin(), ops.end());
+    std::sort(rows.begin(), rows.end(), [] (auto & a, auto & b) {
+        return a.second.forward_self_ns + a.second.backward_self_ns
+            > b.second.forward_self_ns + b.second.backward_self_ns;
+    });
+
+    auto ms = [] (double ns) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.2f", ns * 1e-6);
+        return std::string(buf);
+    };
+    auto col = [] (std::string s, size_t w) { return std::string(w > s.size() ? w - s.size() : 0, ' ') + s; };
+    out << col("calls", 10) << col("fwd ms", 11) << col("fwd self", 11)
+        << col("bwd ms", 11) << col("bwd self", 11) << col("frame B", 9) << "  op" << std::endl;
+    for(auto & [name, s] : rows)
+    {
+        out << col(std::to_string(s.calls), 10)
+            << col(ms(s.forward_ns), 11) << col(ms(s.forward_self_ns), 11)
+            << col(ms(s.backward_ns), 11) << col(ms(s.backward_self_ns), 11)
+            << col(std::to_string(long(s.frame_bytes / std::max(s.calls, 1L))), 9)
+            << "  " << name << std::endl;
+    }
+}
+
+// chrome trace event format, one complete event per span
+inline void profile_trace(std::ostream & out)
+{
+    auto & registry = profile_threads();
+    std::lock_guard lock(registry.lock);
+
+    int64_t t0 = INT64_MAX;
+    for(auto * t : registry.threads)
+        for(auto & s : t->spans) { t0 = std::min(t0, s.start_ns); }
+
+    auto escape = [] (std::string s) {
+        std::string out;
+        for(char c : s) { if(c == '"' || c == '\\') { out += '\\'; } out += c; }
+        return out;
+    };
+
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for(auto * t : registry.threads)
+        for(auto & s : t->spans)
+        {
+            out << (first ? "\n" : ",\n")
+                << "{\"name\": \"" << escape(profile_name(s.stats->function)) << "\", "
+                << "\"cat\": \"" << (s.backward ? "backward" : "forward") << "\", "
+                << "\"ph\": \"X\", "
+                << "\"ts\": " << (s.start_ns - t0) * 1e-3 << ", "
+                << "\"dur\": " << s.dur_ns * 1e-3 << ", "
+                << "\"pid\": 0, \"tid\": " << t->tid << ", "
+                << "\"args\": {\"at\": \"" << escape(profile_site(*s.stats)) << "\"}}";
+            first = false;
+        }
+    out << "\n]}" << std::endl;
+}
+
+// zero the numbers, live ops keep their entries
+inline void profile_reset()
+{
+    auto & registry = profile_threads();
+    std::lock_guard lock(registry.lock);
+    for(auto * t : registry.threads)
+    {
+        for(auto & [_, s] : t->ops) { s = { s.function, s.file, s.line }; }
+        t->spans.clear();
+    }
+}
+
+#else
+
+inline void profile_report(std::ostream & out) { out << "built without GAII_PROFILE" << std::endl; }
+inline void profile_trace(std::ostream & out) { out << "{\"traceEvents\": []}" << std::endl; }
+inline void profile_reset() {}
+
+#endif
+
+
+} // namespace gaii
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "gaii/tensor.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace gaii {
+
+
+// int8 inference with trained weights
+//
+// weights are quantized once, symmetric with one scale per output column
+//   w[j, k] ~ q[j, k] * scale[k]
+// and activations per row as they arrive, x[i, j] ~ qx[i, j] * sx[i], so
+//   (x @ w)[i, k] ~ (qx @ q)[i, k] * sx[i] * scale[k]
+// with the sums in int32
+//
+//   auto qw = quantize(value(w));
+//   tensor<float, B, K> y = x % qw;    // no-grad only
+//
+// with avx512 vnni the sums are vpdpbusd, 4 products per int32 lane, which
+// takes a unsigned: a is offset by 128, and 128 * the column sums of q come back out
+
+
+// q is packed for the kernel, groups of 4 rows interleaved per column as
+// [J4/4, K, 4], with J padded to J4 by zero rows
+template<int J, int K>
+struct qweights
+{
+    static constexpr int J4 = (J + 3) / 4 * 4;
+
+    heap_tensor<int8_t, J4/4, K, 4> q;
+    tensor<float, K> scale;
+    tensor<int32_t, K> colsum;
+
+    static constexpr int size(int i) { return i == 0 ? J : K; }
+
+    float dequant(int j, int k) const { return q(j/4, k, j%4).item() * scale(k).item(); }
+};
+
+template<tensor_ref W>
+auto quantize(W const& w)
+{
+    static_assert(W::ndim() == 2, "quantize takes 2-d weights");
+    constexpr int J = W::size(0);
+    constexpr int K = W::size(1);
+
+    qweights<J, K> out;
+    out.q = 0;
+    out.colsum = 0;
+    for(int k=0 ; k<K ; k++)
+    {
+        float m = 0;
+        for(int j=0 ; j<J ; j++) { m = std::max(m, std::abs(float(w(j, k)))); }
+        out.scale(k) = m > 0 ? m / 127 : 1;
+    }
+    for(int j=0 ; j<J ; j++)
+        for(int k=0 ; k<K ; k++)
+        {
+            int v = std::lround(float(w(j, k)) / out.scale(k));
+            out.q(j/4, k, j%4) = v;
+            out.colsum(k) += v;
+        }
+    return out;
+}
+
+// one row of J floats to J4 int8, zero padded, returns its scale
+template<int J, int J4>
+float quantize_row(float const* x, int8_t * q)
+{
+    float m = 0;
+    for(int j=0 ; j<J ; j++) { m = std::max(m, std::abs(x[j])); }
+    float s = m > 0 ? m / 127 : 1;
+    float inv = 1 / s;
+    for(int j=0 ; j<J ; j++)
+    {
+        float v = x[j] * inv;
+        q[j] = int8_t(v + (v < 0 ? -0.5f : 0.5f));
+    }
+    for(int j=J ; j<J4 ; j++) { q[j] = 0; }
+    return s;
+}
+
+
+#if defined(__AVX512VNNI__)
+
+// MR x NV*16 block of c in registers, the last vector masked to the columns left
+template<int MR, int NV, int J4, int K>
+void qgemm_tile(int8_t const* a, int8_t const* b, int32_t const* colsum, int32_t * c, __mmask16 tail)
+{
+    __m512i acc[MR][NV];
+    for(int m=0 ; m<MR ; m++)
+        for(int v=0 ; v<NV ; v++) { acc[m][v] = _mm512_setzero_si512(); }
+
+    for(int g=0 ; g<J4/4 ; g++)
+    {
+        __m512i bv[NV];
+        for(int v=0 ; v<NV ; v++)
+        {
+            bv[v] = _mm512_maskz_loadu_epi32(v == NV-1 ? tail : 0xffff, b + (g*K + v*16) * 4);
+        }
+        for(int m=0 ; m<MR ; m++)
+        {
+            uint32_t p;
+            std::memcpy(&p, a + m*J4 + g*4, 4);
+            __m512i av = _mm512_set1_epi32(p ^ 0x80808080); // + 128, as unsigned
+            for(int v=0 ; v<NV ; v++) { acc[m][v] = _mm512_dpbusd_epi32(acc[m][v], av, bv[v]); }
+        }
+    }
+
+    for(int v=0 ; v<NV ; v++)
+    {
+        __mmask16 mask = v == NV-1 ? tail : 0xffff;
+        __m512i offset = _mm512_maskz_slli_epi32(mask, _mm512_maskz_loadu_epi32(mask, colsum + v*16), 7);
+        for(int m=0 ; m<MR ; m++)
+        {
+            _mm512_mask_storeu_epi32(c + m*K + v*16, mask, _mm512_sub_epi32(acc[m][v], offset));
+        }
+    }
+}
+
+#endif
+
+
+// c[I, K] = a[I, J4] @ q, int8 in and int32 out
+template<int I, int J, int K>
+void qgemm(int8_t const* a, qweights<J, K> const& w, int32_t * c)
+{
+    constexpr int J4 = qweights<J, K>::J4;
+    int8_t const* b = w.q.raw();
+
+#if defined(__AVX512VNNI__)
+    constexpr int MR = 8;
+    constexpr int NV = 2;
+    constexpr int NR = NV * 16;
+    constexpr int I0 = I / MR * MR;
+    constexpr int K0 = K / NR * NR;
+    int32_t const* colsum = w.colsum.raw();
+
+    // a panel of q is 32 columns of all J, reused by every row tile
+    for(int k0=0 ; k0<K0 ; k0+=NR)
+    {
+        for(int i0=0 ; i0<I0 ; i0+=MR)
+        {
+            qgemm_tile<MR, NV, J4, K>(a + i0*J4, b + k0*4, colsum + k0, c + i0*K + k0, 0xffff);
+        }
+        for(int i0=I0 ; i0<I ; i0++)
+        {
+            qgemm_tile<1, NV, J4, K>(a + i0*J4, b + k0*4, colsum + k0, c + i0*K + k0, 0xffff);
+        }
+    }
+    for(int k0=K0 ; k0<K ; k0+=16)
+    {
+        __mmask16 tail = K - k0 >= 16 ? 0xffff : (1 << (K - k0)) - 1;
+        for(int i0=0 ; i0<I ; i0++)
+        {
+            qgemm_tile<1, 1, J4, K>(a + i0*J4, b + k0*4, colsum + k0, c + i0*K + k0, tail);
+        }
+    }
+#else
+    for(int i=0 ; i<I ; i++)
+        for(int k=0 ; k<K ; k++)
+        {
+            int32_t acc = 0;
+            for(int j=0 ; j<J4 ; j++) { acc += a[i*J4 + j] * b[(j/4*K + k)*4 + j%4]; }
+            c[i*K + k] = acc;
+        }
+#endif
+}
+
+
+// x @ w for a 2-d float x, quantized per row on the way in
+template<tensor_ref X, int J, int K>
+auto qmat_mul(X const& x, qweights<J, K> const& w)
+{
+    static_assert(X::ndim() == 2 && X::size(1) == J, "qmat_mul takes [I, J] @ [J, K]");
+    constexpr int I = X::size(0);
+    constexpr int J4 = qweights<J, K>::J4;
+
+    auto_tensor_t<int8_t, I, J4> qx;
+    float sx[I];
+    for(int i=0 ; i<I ; i++) { sx[i] = quantize_row<J, J4>(x.raw() + i*J, qx.raw() + i*J4); }
+
+    auto_tensor_t<int32_t, I, K> acc;
+    qgemm<I>(qx.raw(), w, acc.raw());
+
+    auto_tensor_t<float, I, K> out;
+    int32_t const* ai = acc.raw();
+    float * yi = out.raw();
+    float const* scale = w.scale.raw();
+    for(int i=0 ; i<I ; i++, ai+=K, yi+=K)
+        for(int k=0 ; k<K ; k++) { yi[k] = ai[k] * (sx[i] * scale[k]); }
+    return out;
+}
+
+template<tensor_ref X, int J, int K>
+auto operator%(X const& x, qweights<J, K> const& w)
+{
+    return qmat_mul(x, w);
+}
+
+
+} // namespace gaii
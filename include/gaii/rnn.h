@@ -0,0 +1,223 @@
+#pragma once
+
+#include "gaii/math.h"
+
+namespace gaii {
+
+
+// GRU cell as one op, with gate weights packed along the output dim as [z | r | n]
+//
+//   w_x [Nin, 3N], w_h [N, 3N], b [3N]
+//   z = sigmoid(x w_xz + h w_hz + b_z)
+//   r = sigmoid(x w_xr + h w_hr + b_r)
+//   n = tanh(x w_xn + r * (h w_hn) + b_n)
+//   h' = (1 - z) * h + z * n
+//
+// r is applied after the h matmul, so each step needs one GEMM for x and one for h
+// the frame keeps z, r, n and h w_hn, and backward is derived by hand
+
+
+// gate nonlinearities for all rows, each over the whole [B, N] block
+template<class GX, class GH, class HP, class H>
+void gru_gates(GX const& gx, GH const& gh, HP const& h, H & z, H & r, H & n, H & ghn, H & out)
+{
+    constexpr int B = H::size(0);
+    constexpr int N = H::size(1);
+    auto xz = slice<0, N, 1>(gx);
+    auto xr = slice<N, 2*N, 1>(gx);
+    auto xn = slice<2*N, 3*N, 1>(gx);
+    auto hz = slice<0, N, 1>(gh);
+    auto hr = slice<N, 2*N, 1>(gh);
+    auto hn = slice<2*N, 3*N, 1>(gh);
+    for(int i=0 ; i<B ; i++)
+        for(int j=0 ; j<N ; j++)
+        {
+            z(i, j) = xz(i, j) + hz(i, j);
+            r(i, j) = xr(i, j) + hr(i, j);
+        }
+    vsigmoid(z.raw(), z.raw(), H::size());
+    vsigmoid(r.raw(), r.raw(), H::size());
+    for(int i=0 ; i<B ; i++)
+        for(int j=0 ; j<N ; j++)
+        {
+            ghn(i, j) = hn(i, j);
+            n(i, j) = xn(i, j) + r(i, j) * hn(i, j);
+        }
+    vtanh(n.raw(), n.raw(), H::size());
+    for(int i=0 ; i<B ; i++)
+        for(int j=0 ; j<N ; j++)
+        {
+            out(i, j) = (1 - z(i, j)) * h(i, j).item() + z(i, j) * n(i, j);
+        }
+}
+
+
+template<class X, class H, class WX, class WH, class Bias>
+auto gru_cell(X && x, H && h, WX && w_x, WH && w_h, Bias && b)
+{
+    using Hidden = std::remove_cvref_t<decltype(value(h))>;
+    using Gates = decltype(value(x) % value(w_x));
+    static_assert(Gates::size(1) == 3 * Hidden::size(1), "gate weights must be [_, 3N]");
+
+    if constexpr ( !(diffable<X> || diffable<H> || diffable<WX> || diffable<WH> || diffable<Bias>) )
+    {
+        // no-grad
+        Gates gx = x % w_x;
+        gx += b;
+        Gates gh = h % w_h;
+        Hidden z, r, n, ghn, out;
+        gru_gates(gx, gh, h, z, r, n, ghn, out);
+        return out;
+    }
+    else return [] (X x, H h, WX w_x, WH w_h, Bias b) -> op<var<Hidden>> {
+        using T = element_type<Hidden>;
+        constexpr int B = Hidden::size(0);
+        constexpr int N = Hidden::size(1);
+
+        Hidden z, r, n, ghn;
+        var<Hidden> y;
+        {
+            Gates gx = value(x) % value(w_x);
+            gx += value(b);
+            Gates gh = value(h) % value(w_h);
+            gru_gates(gx, gh, value(h), z, r, n, ghn, y.value);
+        }
+        co_yield y;
+
+        Gates dgx, dgh;
+        Hidden dh;
+        auto dxz = slice<0, N, 1>(dgx);
+        auto dxr = slice<N, 2*N, 1>(dgx);
+        auto dxn = slice<2*N, 3*N, 1>(dgx);
+        for(int i=0 ; i<B ; i++)
+            for(int j=0 ; j<N ; j++)
+            {
+                T dy = y.grad(i, j);
+                T zi = z(i, j);
+                T ri = r(i, j);
+                T ni = n(i, j);
+                T dz = dy * (ni - value(h)(i, j).item()) * zi * (1 - zi);
+                T dn = dy * zi * (1 - ni * ni);
+                T dr = dn * ghn(i, j).item() * ri * (1 - ri);
+                dxz(i, j) = dz;
+                dxr(i, j) = dr;
+                dxn(i, j) = dn;
+                dh(i, j) = dy * (1 - zi);
+            }
+        // only the n gate differs for h, where r came after the matmul
+        dgh = dgx;
+        slice<2*N, 3*N, 1>(dgh) *= r;
+        dh += mat_mul<false, true>(dgh, value(w_h));
+
+        // input grads first, an eager optimizer updates a weight on its backward
+        auto dx = mat_mul<false, true>(dgx, value(w_x));
+        backward(h, dh);
+        backward(x, dx);
+        backward(b, dgx);
+        backward(w_h, mat_mul<true, false>(value(h), dgh));
+        backward(w_x, mat_mul<true, false>(value(x), dgx));
+    }(fwd<X>(x), fwd<H>(h), fwd<WX>(w_x), fwd<WH>(w_h), fwd<Bias>(b));
+}
+
+
+// the cell over a whole sequence, xs [T, B, Nin] and h0 [B, N] to hs [T, B, N]
+//
+// the input projections don't depend on h, so all T of them are one
+// [T*B, Nin] x [Nin, 3N] GEMM up front, and only h w_h is left per step.
+// backward is the same the other way: only dh goes back step by step, and
+// dw_x, dw_h and dxs are each one GEMM over all T*B rows
+
+// all T steps, keeping each step's gates
+template<class XS, class H0, class WX, class WH, class Bias, class S>
+void gru_sequence_steps(XS const& xs, H0 const& h0, WX const& w_x, WH const& w_h, Bias const& b,
+    S & z, S & r, S & n, S & ghn, S & hs)
+{
+    constexpr int T = S::size(0);
+    constexpr int B = S::size(1);
+    constexpr int N = S::size(2);
+    constexpr int Nin = XS::size(2);
+
+    auto_tensor_t<element_type<S>, T, B, 3*N> gx;
+    reshape<T*B, 3*N>(gx) = reshape<T*B, Nin>(xs) % w_x;
+    gx += b;
+
+    auto step = [&] (int t, auto const& h) {
+        auto gh = h % w_h;
+        gru_gates(gx[t], gh, h, z[t], r[t], n[t], ghn[t], hs[t]);
+    };
+    step(0, h0);
+    for(int t=1 ; t<T ; t++) { step(t, hs[t-1]); }
+}
+
+template<class XS, class H, class WX, class WH, class Bias>
+auto gru_sequence(XS && xs, H && h0, WX && w_x, WH && w_h, Bias && b)
+{
+    using Hidden = std::remove_cvref_t<decltype(value(h0))>;
+    using Inputs = std::remove_cvref_t<decltype(value(xs))>;
+    constexpr int T = Inputs::size(0);
+    constexpr int B = Hidden::size(0);
+    constexpr int N = Hidden::size(1);
+    constexpr int Nin = Inputs::size(2);
+    static_assert(Inputs::size(1) == B, "xs must be [T, B, Nin]");
+    using Seq = auto_tensor_t<element_type<Hidden>, T, B, N>;
+
+    if constexpr ( !(diffable<XS> || diffable<H> || diffable<WX> || diffable<WH> || diffable<Bias>) )
+    {
+        // no-grad
+        Seq z, r, n, ghn, hs;
+        gru_sequence_steps(xs, h0, w_x, w_h, b, z, r, n, ghn, hs);
+        return hs;
+    }
+    else return [] (XS xs, H h0, WX w_x, WH w_h, Bias b) -> op<var<Seq>> {
+        using E = element_type<Hidden>;
+
+        Seq z, r, n, ghn;
+        var<Seq> y;
+        gru_sequence_steps(value(xs), value(h0), value(w_x), value(w_h), value(b), z, r, n, ghn, y.value);
+        co_yield y;
+
+        // h before each step, for the gradients through it
+        Seq hp;
+        hp[0] = value(h0);
+        for(int t=1 ; t<T ; t++) { hp[t] = y.value[t-1]; }
+
+        auto_tensor_t<E, T, B, 3*N> dgx, dgh;
+        Hidden dh = 0; // into the h before step t, from the steps after it
+        for(int t=T-1 ; t>=0 ; t--)
+        {
+            auto dxz = slice<0, N, 1>(dgx[t]);
+            auto dxr = slice<N, 2*N, 1>(dgx[t]);
+            auto dxn = slice<2*N, 3*N, 1>(dgx[t]);
+            for(int i=0 ; i<B ; i++)
+                for(int j=0 ; j<N ; j++)
+                {
+                    E dy = y.grad(t, i, j) + dh(i, j);
+                    E zi = z(t, i, j);
+                    E ri = r(t, i, j);
+                    E ni = n(t, i, j);
+                    E dz = dy * (ni - hp(t, i, j)) * zi * (1 - zi);
+                    E dn = dy * zi * (1 - ni * ni);
+                    E dr = dn * ghn(t, i, j) * ri * (1 - ri);
+                    dxz(i, j) = dz;
+                    dxr(i, j) = dr;
+                    dxn(i, j) = dn;
+                    dh(i, j) = dy * (1 - zi);
+                }
+            dgh[t] = dgx[t];
+            slice<2*N, 3*N, 1>(dgh[t]) *= r[t];
+            dh += mat_mul<false, true>(dgh[t], value(w_h));
+        }
+
+        auto dgx_rows = reshape<T*B, 3*N>(dgx);
+        auto dgh_rows = reshape<T*B, 3*N>(dgh);
+        auto dxs = mat_mul<false, true>(dgx_rows, value(w_x));
+        backward(h0, dh);
+        backward(xs, reshape<T, B, Nin>(dxs));
+        backward(b, dgx_rows);
+        backward(w_h, mat_mul<true, false>(reshape<T*B, N>(hp), dgh_rows));
+        backward(w_x, mat_mul<true, false>(reshape<T*B, Nin>(value(xs)), dgx_rows));
+    }(fwd<XS>(xs), fwd<H>(h0), fwd<WX>(w_x), fwd<WH>(w_h), fwd<Bias>(b));
+}
+
+
+} // namespace gaii
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace gaii {
+
+
+// register type picked at compile time, W lanes of T
+//
+// band, bor, ftoi, itof and select_lt are for float lanes:
+// ftoi truncates to int32 and leaves its bits in the lane, itof reads
+// the lane bits as int32 and converts, select_lt(a, b, x, y) is a < b ? x : y
+
+template<class T>
+struct simd1;
+
+template<class T>
+struct simd
+{
+    // portable fallback, a small fixed loop the compiler can vectorize
+    static constexpr int W = 4;
+    static constexpr int MR = 4;
+    struct reg { T v[W]; };
+
+    static reg zero() { return {}; }
+    static reg set1(T x) { reg r; for(int i=0 ; i<W ; i++) { r.v[i] = x; } return r; }
+    static reg load(T const* p) { reg r; for(int i=0 ; i<W ; i++) { r.v[i] = p[i]; } return r; }
+    static void store(T * p, reg r) { for(int i=0 ; i<W ; i++) { p[i] = r.v[i]; } }
+    static reg fmadd(reg a, reg b, reg c)
+    {
+        for(int i=0 ; i<W ; i++) { c.v[i] += a.v[i] * b.v[i]; }
+        return c;
+    }
+    template<class F>
+    static reg map(reg a, reg b, F f) { for(int i=0 ; i<W ; i++) { a.v[i] = f(a.v[i], b.v[i]); } return a; }
+    static reg add(reg a, reg b) { return map(a, b, [] (T x, T y) { return x + y; }); }
+    static reg sub(reg a, reg b) { return map(a, b, [] (T x, T y) { return x - y; }); }
+    static reg mul(reg a, reg b) { return map(a, b, [] (T x, T y) { return x * y; }); }
+    static reg div(reg a, reg b) { return map(a, b, [] (T x, T y) { return x / y; }); }
+    static reg min(reg a, reg b) { return map(a, b, [] (T x, T y) { return std::min(x, y); }); }
+    static reg max(reg a, reg b) { return map(a, b, [] (T x, T y) { return std::max(x, y); }); }
+    static reg sqrt(reg a) { return map(a, a, [] (T x, T) { return std::sqrt(x); }); }
+    static reg band(reg a, reg b) { return map(a, b, [] (T x, T y) { return simd1<T>::band(x, y); }); }
+    static reg bor(reg a, reg b) { return map(a, b, [] (T x, T y) { return simd1<T>::bor(x, y); }); }
+    static reg ftoi(reg a) { return map(a, a, [] (T x, T) { return simd1<T>::ftoi(x); }); }
+    static reg itof(reg a) { return map(a, a, [] (T x, T) { return simd1<T>::itof(x); }); }
+    static reg select_lt(reg a, reg b, reg x, reg y)
+    {
+        for(int i=0 ; i<W ; i++) { x.v[i] = a.v[i] < b.v[i] ? x.v[i] : y.v[i]; }
+        return x;
+    }
+    static T reduce(reg r)
+    {
+        T out = 0;
+        for(int i=0 ; i<W ; i++) { out += r.v[i]; }
+        return out;
+    }
+};
+
+#if defined(__AVX512F__)
+
+template<>
+struct simd<float>
+{
+    static constexpr int W = 16;
+    static constexpr int MR = 8;
+    using reg = __m512;
+
+    static reg zero() { return _mm512_setzero_ps(); }
+    static reg set1(float x) { return _mm512_set1_ps(x); }
+    static reg load(float const* p) { return _mm512_loadu_ps(p); }
+    static void store(float * p, reg r) { _mm512_storeu_ps(p, r); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+    // maskz forms, gcc 12 warns on the undefined passthrough of the plain ones
+    static reg min(reg a, reg b) { return _mm512_maskz_min_ps(0xffff, a, b); }
+    static reg max(reg a, reg b) { return _mm512_maskz_max_ps(0xffff, a, b); }
+    static reg sqrt(reg a) { return _mm512_maskz_sqrt_ps(0xffff, a); }
+    static reg ftoi(reg a) { return _mm512_castsi512_ps(_mm512_maskz_cvttps_epi32(0xffff, a)); }
+    static reg itof(reg a) { return _mm512_maskz_cvtepi32_ps(0xffff, _mm512_castps_si512(a)); }
+    static reg band(reg a, reg b)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+    }
+    static reg bor(reg a, reg b)
+    {
+        return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+    }
+    static reg select_lt(reg a, reg b, reg x, reg y)
+    {
+        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ), y, x);
+    }
+    static float reduce(reg r)
+    {
+        alignas(64) float x[W];
+        _mm512_store_ps(x, r);
+        float out = 0;
+        for(int i=0 ; i<W ; i++) { out += x[i]; }
+        return out;
+    }
+};
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+template<>
+struct simd<float>
+{
+    static constexpr int W = 8;
+    static constexpr int MR = 6;
+    using reg = __m256;
+
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg set1(float x) { return _mm256_set1_ps(x); }
+    static reg load(float const* p) { return _mm256_loadu_ps(p); }
+    static void store(float * p, reg r) { _mm256_storeu_ps(p, r); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+    static reg band(reg a, reg b) { return _mm256_and_ps(a, b); }
+    static reg bor(reg a, reg b) { return _mm256_or_ps(a, b); }
+    static reg ftoi(reg a) { return _mm256_castsi256_ps(_mm256_cvttps_epi32(a)); }
+    static reg itof(reg a) { return _mm256_cvtepi32_ps(_mm256_castps_si256(a)); }
+    static reg select_lt(reg a, reg b, reg x, reg y)
+    {
+        return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+    }
+    static float reduce(reg r)
+    {
+        __m128 x = _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1));
+        x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+        return _mm_cvtss_f32(_mm_add_ss(x, _mm_shuffle_ps(x, x, 1)));
+    }
+};
+
+#elif defined(__SSE2__)
+
+template<>
+struct simd<float>
+{
+    static constexpr int W = 4;
+    static constexpr int MR = 4;
+    using reg = __m128;
+
+    static reg zero() { return _mm_setzero_ps(); }
+    static reg set1(float x) { return _mm_set1_ps(x); }
+    static reg load(float const* p) { return _mm_loadu_ps(p); }
+    static void store(float * p, reg r) { _mm_storeu_ps(p, r); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+    static reg band(reg a, reg b) { return _mm_and_ps(a, b); }
+    static reg bor(reg a, reg b) { return _mm_or_ps(a, b); }
+    static reg ftoi(reg a) { return _mm_castsi128_ps(_mm_cvttps_epi32(a)); }
+    static reg itof(reg a) { return _mm_cvtepi32_ps(_mm_castps_si128(a)); }
+    static reg select_lt(reg a, reg b, reg x, reg y)
+    {
+        __m128 m = _mm_cmplt_ps(a, b);
+        return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+    }
+    static float reduce(reg r)
+    {
+        __m128 x = _mm_add_ps(r, _mm_movehl_ps(r, r));
+        return _mm_cvtss_f32(_mm_add_ss(x, _mm_shuffle_ps(x, x, 1)));
+    }
+};
+
+#endif
+
+
+// one lane with the same interface, for loop tails
+template<class T>
+struct simd1
+{
+    static constexpr int W = 1;
+    using reg = T;
+
+    static reg zero() { return 0; }
+    static reg set1(T x) { return x; }
+    static reg load(T const* p) { return *p; }
+    static void store(T * p, reg r) { *p = r; }
+    static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg min(reg a, reg b) { return std::min(a, b); }
+    static reg max(reg a, reg b) { return std::max(a, b); }
+    static reg sqrt(reg a) { return std::sqrt(a); }
+    static reg band(reg a, reg b) { return std::bit_cast<T>(std::bit_cast<int32_t>(a) & std::bit_cast<int32_t>(b)); }
+    static reg bor(reg a, reg b) { return std::bit_cast<T>(std::bit_cast<int32_t>(a) | std::bit_cast<int32_t>(b)); }
+    static reg ftoi(reg a) { return std::bit_cast<T>(int32_t(a)); }
+    static reg itof(reg a) { return T(std::bit_cast<int32_t>(a)); }
+    static reg select_lt(reg a, reg b, reg x, reg y) { return a < b ? x : y; }
+    static T reduce(reg r) { return r; }
+};
+
+
+// f.template operator()<S>(i) over [0, n), W lanes at a time, then one at a time
+template<class T, class F>
+void simd_loop(int n, F && f)
+{
+    using S = simd<T>;
+    int i = 0;
+    for( ; i + S::W <= n ; i += S::W) { f.template operator()<S>(i); }
+    for( ; i < n ; i++) { f.template operator()<simd1<T>>(i); }
+}
+
+
+
+} // namespace gaii
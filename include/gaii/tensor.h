@@ -1,7 +1,26 @@
 #pragma once
 
+#include "gaii/gemm.h"
+#include "gaii/half.h"
+#include "gaii/pool.h"
+#include "gaii/vmath.h"
+
 #include <concepts>
 #include <algorithm>
+#include <cmath>
+#include <array>
+#include <new>
+#include <utility>
+
+// kernels that make new tensors put ones bigger than this on the heap
+#ifndef GAII_HEAP_TENSOR_BYTES
+#define GAII_HEAP_TENSOR_BYTES (1 << 16)
+#endif
+
+// bytes of freed heap tensor buffers a heap_cache_scope keeps for reuse, 0 for none
+#ifndef GAII_HEAP_TENSOR_CACHE
+#define GAII_HEAP_TENSOR_CACHE (1 << 24)
+#endif
 
 namespace gaii {
 
@@ -9,6 +28,12 @@ namespace gaii {
 template<class T, int... N>
 struct tensor;
 
+template<class T, int... N>
+struct heap_tensor;
+
+template<class T, auto Shape, auto Strides>
+struct tensor_view;
+
 
 template<class T>
 struct is_tensor_helper { static constexpr bool value = false; };
@@ -16,17 +41,43 @@ struct is_tensor_helper { static constexpr bool value = false; };
 template<class T, int... N>
 struct is_tensor_helper<tensor<T, N...>> { static constexpr bool value = true; };
 
+template<class T, int... N>
+struct is_tensor_helper<heap_tensor<T, N...>> { static constexpr bool value = true; };
+
+template<class T, auto Shape, auto Strides>
+struct is_tensor_helper<tensor_view<T, Shape, Strides>> { static constexpr bool value = true; };
+
 template<class T>
 concept tensor_ref = is_tensor_helper<std::remove_cvref_t<T>>::value;
 
 template<class T>
-concept scalar_ref = std::integral<std::remove_cvref_t<T>> || std::floating_point<std::remove_cvref_t<T>>;
+struct is_view_helper { static constexpr bool value = false; };
+
+template<class T, auto Shape, auto Strides>
+struct is_view_helper<tensor_view<T, Shape, Strides>> { static constexpr bool value = true; };
 
 template<class T>
-concept tensor_arg = tensor_ref<T> || scalar_ref<T>;
+concept view_ref = is_view_helper<std::remove_cvref_t<T>>::value;
 
+template<class T>
+concept scalar_ref = std::integral<std::remove_cvref_t<T>> || std::floating_point<std::remove_cvref_t<T>>
+    || half_ref<T>;
+
+// lazy expressions (gaii/lazy.h) index like tensors, and evaluate on assignment
+template<class T>
+struct is_lazy_helper { static constexpr bool value = false; };
+
+template<class T>
+concept lazy_ref = is_lazy_helper<std::remove_cvref_t<T>>::value;
+
+template<class T>
+concept tensor_like = tensor_ref<T> || lazy_ref<T>;
+
+template<class T>
+concept tensor_arg = tensor_like<T> || scalar_ref<T>;
 
-template<tensor_ref T> 
+
+template<tensor_like T> 
 T && as_tensor(T && a) { return std::forward<T>(a); }
 
 template<scalar_ref T>
@@ -129,9 +180,394 @@ struct tensor<T, N0, Ns...>
     }
 };
 
+
+// buffers of freed heap tensors, kept on their thread for the next one of
+// the same size. a loop that makes and drops a few big tensors every step
+// then reuses the same warm memory, where the allocator could hand back
+// fresh pages each time, and fault every one of them in again
+//
+// threads only cache while a heap_cache_scope is open on them, and the
+// buffers are freed when it closes, so each open scope holds at most
+// GAII_HEAP_TENSOR_CACHE bytes. data_parallel opens one on each worker
+struct heap_block_cache
+{
+    static constexpr std::align_val_t ALIGN {64};
+    static constexpr int SLOTS = 32;
+
+    struct slot
+    {
+        void * ptr;
+        std::size_t bytes;
+    };
+
+    slot slots[SLOTS];   // oldest first
+    int count = 0;
+    std::size_t bytes = 0;
+
+    heap_block_cache() = default;
+    heap_block_cache(heap_block_cache const&) = delete;
+    ~heap_block_cache()
+    {
+        for(int i=0 ; i<count ; i++) { ::operator delete(slots[i].ptr, ALIGN); }
+    }
+
+    // null unless a heap_cache_scope is open on this thread
+    static heap_block_cache *& local()
+    {
+        thread_local heap_block_cache * c = nullptr;
+        return c;
+    }
+
+    void take(int i)
+    {
+        bytes -= slots[i].bytes;
+        std::copy(slots + i + 1, slots + count, slots + i);
+        count --;
+    }
+
+    static void * allocate(std::size_t n)
+    {
+        if(heap_block_cache * c = local())
+        {
+            // newest first, it is the likeliest to still be in cache
+            for(int i=c->count-1 ; i>=0 ; i--)
+            {
+                if(c->slots[i].bytes != n) { continue; }
+                void * p = c->slots[i].ptr;
+                c->take(i);
+                return p;
+            }
+        }
+        return ::operator new(n, ALIGN);
+    }
+
+    static void deallocate(void * p, std::size_t n) noexcept
+    {
+        heap_block_cache * c = local();
+        if(!c || n > GAII_HEAP_TENSOR_CACHE)
+        {
+            ::operator delete(p, ALIGN);
+            return;
+        }
+        while(c->count == SLOTS || c->bytes + n > GAII_HEAP_TENSOR_CACHE)
+        {
+            ::operator delete(c->slots[0].ptr, ALIGN);
+            c->take(0);
+        }
+        c->slots[c->count++] = { p, n };
+        c->bytes += n;
+    }
+};
+
+
+// caches freed heap tensor buffers on this thread until it closes
+// tensors freed after that go straight back to the allocator
+struct heap_cache_scope
+{
+    heap_block_cache m_cache;
+    heap_block_cache * m_prev;
+
+    heap_cache_scope()
+    :   m_prev(heap_block_cache::local())
+    {
+        heap_block_cache::local() = &m_cache;
+    }
+    heap_cache_scope(heap_cache_scope const&) = delete;
+    ~heap_cache_scope() { heap_block_cache::local() = m_prev; }
+};
+
+
+// same shape and api as tensor, but the elements live in a 64 byte aligned
+// heap buffer, so big tensors stay off the stack and out of coroutine frames
+// moves are O(1), and a moved-from heap_tensor is empty
+template<class T, int... N>
+struct heap_tensor
+{
+    static_assert(sizeof...(N) > 0, "heap_tensor needs at least one dim");
+
+    using tensor_type = tensor<T, N...>;
+    using element_type = T;
+    using subtensor = typename tensor_type::subtensor;
+
+    tensor_type * m_ptr;
+
+    static constexpr int size() { return tensor_type::size(); }
+    static constexpr int size(int i) { return tensor_type::size(i); }
+    static constexpr int ndim() { return tensor_type::ndim(); }
+
+    heap_tensor()
+    :   m_ptr(new (heap_block_cache::allocate(sizeof(tensor_type))) tensor_type)
+    {}
+    heap_tensor(heap_tensor && o) noexcept
+    :   m_ptr(std::exchange(o.m_ptr, nullptr))
+    {}
+    heap_tensor(heap_tensor const& o) : heap_tensor() { *m_ptr = *o.m_ptr; }
+
+    template<tensor_arg Tb>
+    requires (!std::same_as<std::remove_cvref_t<Tb>, heap_tensor>)
+    heap_tensor(Tb && b) : heap_tensor() { assign(*m_ptr, std::forward<Tb>(b)); }
+
+    ~heap_tensor()
+    {
+        if(m_ptr)
+        {
+            m_ptr->~tensor_type();
+            heap_block_cache::deallocate(m_ptr, sizeof(tensor_type));
+        }
+    }
+
+    heap_tensor & operator=(heap_tensor && o) noexcept
+    {
+        std::swap(m_ptr, o.m_ptr);
+        return *this;
+    }
+    heap_tensor & operator=(heap_tensor const& o)
+    {
+        storage() = *o.m_ptr;
+        return *this;
+    }
+
+    template<tensor_arg Tb>
+    requires (!std::same_as<std::remove_cvref_t<Tb>, heap_tensor>)
+    heap_tensor & operator=(Tb && b)
+    {
+        assign(storage(), std::forward<Tb>(b));
+        return *this;
+    }
+
+    // the buffer to assign into, a moved-from heap_tensor gets a new one
+    tensor_type & storage()
+    {
+        if(!m_ptr) { m_ptr = new (heap_block_cache::allocate(sizeof(tensor_type))) tensor_type; }
+        return *m_ptr;
+    }
+
+    tensor_type & get() { return *m_ptr; }
+    tensor_type const& get() const { return *m_ptr; }
+
+    T * raw() { return m_ptr->raw(); }
+    T const* raw() const { return m_ptr->raw(); }
+
+    auto & operator[](int i0) { return (*m_ptr)[i0]; }
+    auto & operator[](int i0) const { return (*m_ptr)[i0]; }
+
+    template<class... Ints>
+    auto & operator()(Ints... ix) { return (*m_ptr)(ix...); }
+    template<class... Ints>
+    auto & operator()(Ints... ix) const { return (*m_ptr)(ix...); }
+
+    template<class F>
+    heap_tensor & apply(F && f)
+    {
+        m_ptr->apply(f);
+        return *this;
+    }
+};
+
+// inline storage for small shapes, heap storage past GAII_HEAP_TENSOR_BYTES
+template<class T, int... N>
+using auto_tensor_t = std::conditional_t<
+    (sizeof(tensor<T, N...>) > GAII_HEAP_TENSOR_BYTES),
+    heap_tensor<T, N...>, tensor<T, N...>>;
+
+
 template<tensor_ref T>
 using element_type = typename T::element_type;
 
+// the same storage with float elements, e.g. the fp32 copy of a half tensor
+template<class T>
+struct float_tensor_helper;
+
+template<class T, int... N>
+struct float_tensor_helper<tensor<T, N...>> { using type = tensor<float, N...>; };
+
+template<class T, int... N>
+struct float_tensor_helper<heap_tensor<T, N...>> { using type = heap_tensor<float, N...>; };
+
+template<class T>
+using float_tensor_t = typename float_tensor_helper<std::remove_cvref_t<T>>::type;
+
+template<std::size_t D>
+constexpr auto view_tail(std::array<int, D> a)
+{
+    std::array<int, D-1> out {};
+    for(std::size_t i=1 ; i<D ; i++) { out[i-1] = a[i]; }
+    return out;
+}
+
+template<std::size_t D>
+constexpr auto contiguous_strides(std::array<int, D> shape)
+{
+    std::array<int, D> out {};
+    int s = 1;
+    for(int i=int(D)-1 ; i>=0 ; i--) { out[i] = s; s *= shape[i]; }
+    return out;
+}
+
+// zero-copy view of strided elements, shape and strides are fixed at compile time
+//
+//   auto wt = transpose(w);          // [K, J] view of a [J, K] tensor
+//   auto wz = slice<0, N, 1>(w_x);   // first N columns
+//   auto flat = reshape<J*K>(w);
+//
+// copying a view is shallow, like a pointer, but assigning to one
+// writes through to the elements it refers to
+template<class T, auto Shape, auto Strides>
+struct tensor_view
+{
+    static constexpr int D = Shape.size();
+    static_assert(Strides.size() == D, "one stride per dim");
+
+    static constexpr auto shape = Shape;
+    static constexpr auto strides = Strides;
+
+    using element_type = std::remove_const_t<T>;
+
+    T * m_ptr;
+
+    static constexpr int ndim() { return D; }
+    static constexpr int size(int i) { return Shape[i]; }
+    static constexpr int stride(int i) { return Strides[i]; }
+    static constexpr int size()
+    {
+        int n = 1;
+        for(int i=0 ; i<D ; i++) { n *= Shape[i]; }
+        return n;
+    }
+
+    tensor_view(T * ptr) : m_ptr(ptr) {}
+    tensor_view(tensor_view const&) = default;
+
+    tensor_view const& operator=(tensor_view const& b) const { assign(*this, b); return *this; }
+
+    template<tensor_arg Tb>
+    requires (!std::same_as<std::remove_cvref_t<Tb>, tensor_view>)
+    tensor_view const& operator=(Tb && b) const { assign(*this, std::forward<Tb>(b)); return *this; }
+
+    // first element, the rest are strided from it
+    T * raw() const { return m_ptr; }
+
+    auto operator[](int i0) const requires (D > 0)
+    {
+        return tensor_view<T, view_tail(Shape), view_tail(Strides)> { m_ptr + i0 * Strides[0] };
+    }
+
+    template<class... Ints>
+    decltype(auto) operator()(int i0, Ints... ix) const
+    {
+        auto sub = (*this)[i0];
+        if constexpr ( D == 1 ) { return sub.item(); }
+        else if constexpr ( sizeof...(Ints) == 0 ) { return sub; }
+        else { return sub(ix...); }
+    }
+
+    T & item() const requires (D == 0) { return *m_ptr; }
+    operator T&() const requires (D == 0) { return *m_ptr; }
+
+    template<class F>
+    tensor_view const& apply(F && f) const
+    {
+        if constexpr ( D == 0 ) { f(*m_ptr); }
+        else { for(int i=0 ; i<Shape[0] ; i++) { (*this)[i].apply(f); } }
+        return *this;
+    }
+};
+
+template<class Ta>
+constexpr auto shape_of()
+{
+    std::array<int, Ta::ndim()> out {};
+    if constexpr ( Ta::ndim() > 0 )
+    {
+        for(int i=0 ; i<Ta::ndim() ; i++) { out[i] = Ta::size(i); }
+    }
+    return out;
+}
+
+// the tensor type a view's elements would be copied into
+template<class T, auto Shape, class Seq = std::make_index_sequence<Shape.size()>>
+struct dense_helper;
+
+template<class T, auto Shape, std::size_t... I>
+struct dense_helper<T, Shape, std::index_sequence<I...>>
+{
+    using type = tensor<T, Shape[I]...>;
+};
+
+template<view_ref V>
+using dense_t = typename dense_helper<
+    typename std::remove_cvref_t<V>::element_type, std::remove_cvref_t<V>::shape>::type;
+
+
+// view over a whole tensor, views pass through
+template<class Ta>
+requires tensor_ref<Ta> && (!view_ref<Ta>)
+auto view(Ta & a)
+{
+    using A = std::remove_const_t<Ta>;
+    using T = std::conditional_t<std::is_const_v<Ta>, element_type<A> const, element_type<A>>;
+    constexpr auto shape = shape_of<A>();
+    return tensor_view<T, shape, contiguous_strides(shape)> { a.raw() };
+}
+
+template<class T, auto Shape, auto Strides>
+auto view(tensor_view<T, Shape, Strides> v) { return v; }
+
+// contiguous view shaped like tensor type Ta, over raw elements
+template<tensor_ref Ta, class T>
+auto view_as(T * p)
+{
+    constexpr auto shape = shape_of<Ta>();
+    return tensor_view<T, shape, contiguous_strides(shape)> { p };
+}
+
+// a view of a temporary tensor would dangle
+#define GAII_VIEW_ARG(Ta) \
+    static_assert(view_ref<Ta> || std::is_lvalue_reference_v<Ta>, "view of a temporary")
+
+// swap the last two dims
+template<class Ta>
+auto transpose(Ta && a)
+{
+    GAII_VIEW_ARG(Ta);
+    auto v = view(a);
+    using V = decltype(v);
+    static_assert(V::ndim() >= 2, "transpose needs 2 dims");
+    constexpr auto shape = [] (auto x) { std::swap(x[V::D-2], x[V::D-1]); return x; };
+    return tensor_view<std::remove_pointer_t<decltype(v.raw())>,
+        shape(V::shape), shape(V::strides)> { v.raw() };
+}
+
+// elements [Begin, End) along Dim
+template<int Begin, int End, int Dim = 0, class Ta>
+auto slice(Ta && a)
+{
+    GAII_VIEW_ARG(Ta);
+    auto v = view(a);
+    using V = decltype(v);
+    static_assert(Dim < V::ndim(), "slice dim out of range");
+    static_assert(0 <= Begin && Begin <= End && End <= V::size(Dim), "slice out of range");
+    constexpr auto shape = [] { auto x = V::shape; x[Dim] = End - Begin; return x; };
+    return tensor_view<std::remove_pointer_t<decltype(v.raw())>,
+        shape(), V::strides> { v.raw() + Begin * V::stride(Dim) };
+}
+
+// same elements in a new shape, only for contiguous views
+template<int... N, class Ta>
+auto reshape(Ta && a)
+{
+    GAII_VIEW_ARG(Ta);
+    auto v = view(a);
+    using V = decltype(v);
+    static_assert(V::strides == contiguous_strides(V::shape), "reshape needs contiguous elements");
+    static_assert((N * ... * 1) == V::size(), "reshape changes size");
+    constexpr std::array<int, sizeof...(N)> shape {N...};
+    return tensor_view<std::remove_pointer_t<decltype(v.raw())>,
+        shape, contiguous_strides(shape)> { v.raw() };
+}
+
+#undef GAII_VIEW_ARG
+
 template<class ostream, class T>
 ostream & operator<<(ostream & os, tensor<T> const& a)
 {
@@ -150,6 +586,28 @@ ostream & operator<<(ostream & os, tensor<T, N0, Ns...> const& a)
     return os << "]";
 }
 
+template<class ostream, class T, int... N>
+ostream & operator<<(ostream & os, heap_tensor<T, N...> const& a)
+{
+    return os << a.get();
+}
+
+template<class ostream, class T, auto Shape, auto Strides>
+ostream & operator<<(ostream & os, tensor_view<T, Shape, Strides> const& a)
+{
+    if constexpr ( a.ndim() == 0 ) { return os << a.item(); }
+    else
+    {
+        os << "[";
+        for(int i=0 ; i<a.size(0) ; i++)
+        {
+            if(i) { os << ","; }
+            os << a[i];
+        }
+        return os << "]";
+    }
+}
+
 
 
 template<int N0, class Tensor>
@@ -158,7 +616,19 @@ struct stack_helper;
 template<int N0, class T, int... Ns>
 struct stack_helper<N0, tensor<T, Ns...>>
 {
-    using type = tensor<T, N0, Ns...>;
+    using type = auto_tensor_t<T, N0, Ns...>;
+};
+
+template<int N0, class T, int... Ns>
+struct stack_helper<N0, heap_tensor<T, Ns...>>
+{
+    using type = heap_tensor<T, N0, Ns...>;
+};
+
+template<int N0, class T, auto Shape, auto Strides>
+struct stack_helper<N0, tensor_view<T, Shape, Strides>>
+{
+    using type = typename stack_helper<N0, dense_t<tensor_view<T, Shape, Strides>>>::type;
 };
 
 template<int N0, class Tensor>
@@ -180,6 +650,45 @@ auto stack(Gen && gen)
 }
 
 
+// elements of anything with a shape, lazy ones included
+template<class T>
+constexpr std::size_t elements_of()
+{
+    std::size_t n = 1;
+    if constexpr ( T::ndim() > 0 )
+    {
+        for(int i=0 ; i<T::ndim() ; i++) { n *= T::size(i); }
+    }
+    return n;
+}
+
+// the outer loop of a broadcast over enough elements is split across the
+// intra-op pool (gaii/pool.h). ops that return values must not share state
+// between elements, and ops that return nothing may only write their first
+// argument, and only split when each i writes a different part of it.
+// inner loops, and every loop of a small broadcast, stay serial
+
+// stack, on the intra-op pool if a loop of N over Work is worth splitting,
+// so each gen(i) must only write its own part of the result. under
+// GAII_INTRA_OP_MIN it is plain stack, the pool isn't even compiled in
+template<int N, std::size_t Work, class Gen>
+auto split_stack(Gen && gen)
+{
+    if constexpr ( Work < GAII_INTRA_OP_MIN || N < 2 ) { return stack<N>(gen); }
+    else if constexpr (std::is_same_v<decltype(gen(0)), void>)
+    {
+        if(intra_op_split<Work, N>()) { intra_op_pool().parallel_for(N, gen); }
+        else { stack<N>(gen); }
+    }
+    else
+    {
+        if(!intra_op_split<Work, N>()) { return stack<N>(gen); }
+        stack_t<N, decltype(as_tensor(gen(0)))> out;
+        intra_op_pool().parallel_for(N, [&] (int i) { out[i] = gen(i); });
+        return out;
+    }
+}
+
 template<int OpDim, class ARef, class Op>
 auto broadcast(ARef && a, Op op)
 {
@@ -189,7 +698,10 @@ auto broadcast(ARef && a, Op op)
 
     if constexpr ( ATensor::ndim() > OpDim )
     {
-        return stack<ATensor::size(0)>([&] (int i) { 
+        constexpr int N0 = ATensor::size(0);
+        // a void op here could be a reduction into captured state
+        constexpr bool pure = !std::is_void_v<decltype(broadcast<OpDim>(a[0], op))>;
+        return split_stack<N0, pure ? elements_of<ATensor>() : 0>([&] (int i) { 
             return broadcast<OpDim>(a[i], op); 
         });
     }
@@ -200,7 +712,7 @@ auto broadcast(ARef && a, Op op)
 }
 
 
-template<int OpDim, tensor_ref ARef, tensor_ref BRef, class Op>
+template<int OpDim, tensor_like ARef, tensor_like BRef, class Op>
 auto broadcast(ARef && a, BRef && b, Op && op)
 {
     // numpy broadcasting rules
@@ -208,18 +720,23 @@ auto broadcast(ARef && a, BRef && b, Op && op)
     using BTensor = std::remove_reference_t<BRef>;
     static_assert(ATensor::ndim() >= OpDim && BTensor::ndim() >= OpDim,
         "tensor ndim < broadcast op ndim");
+    constexpr std::size_t work = std::max(elements_of<ATensor>(), elements_of<BTensor>());
 
     if constexpr ( ATensor::ndim() > BTensor::ndim() )
     {
         // iterate leading dims in A, broadcast B
-        return stack<ATensor::size(0)>([&] (int i) {
+        constexpr int N0 = ATensor::size(0);
+        return split_stack<N0, work>([&] (int i) {
             return broadcast<OpDim>(a[i], b, op);
         });
     }
     else if constexpr ( ATensor::ndim() < BTensor::ndim() )
     {
         // iterate leading dims in B, broadcast A
-        return stack<BTensor::size(0)>([&] (int i) {
+        // every i sees all of A, so only split if nothing is written to it
+        constexpr int N0 = BTensor::size(0);
+        constexpr bool pure = !std::is_void_v<decltype(broadcast<OpDim>(a, b[0], op))>;
+        return split_stack<N0, pure ? work : 0>([&] (int i) {
             return broadcast<OpDim>(a, b[i], op);
         });
     }
@@ -230,8 +747,10 @@ auto broadcast(ARef && a, BRef && b, Op && op)
         constexpr int B0 = BTensor::size(0);
         constexpr int N0 = A0>B0 ? A0 : B0;
         static_assert(A0==B0 || A0==1 || B0==1, "broadcast mismatch dim");
+        constexpr bool pure = A0 == N0
+            || !std::is_void_v<decltype(broadcast<OpDim>(a[0], b[0], op))>;
 
-        return stack<N0>([&] (int i) {
+        return split_stack<N0, pure ? work : 0>([&] (int i) {
             return broadcast<OpDim>(a[A0>1 ? i : 0], b[B0>1 ? i : 0], op);
         });
     }
@@ -265,7 +784,7 @@ auto operator-(Ta const& A)
 
 
 template<class Ta, class Tb> 
-requires tensor_ref<Ta> || tensor_ref<Tb>
+requires (tensor_ref<Ta> || tensor_ref<Tb>) && (!lazy_ref<Ta> && !lazy_ref<Tb>)
 auto operator+(Ta const& A, Tb const& B)
 {
     return broadcast<0>(as_tensor(A), as_tensor(B),
@@ -273,7 +792,7 @@ auto operator+(Ta const& A, Tb const& B)
 }
 
 template<class Ta, class Tb> 
-requires tensor_ref<Ta> || tensor_ref<Tb>
+requires (tensor_ref<Ta> || tensor_ref<Tb>) && (!lazy_ref<Ta> && !lazy_ref<Tb>)
 auto operator-(Ta const& A, Tb const& B)
 {
     return broadcast<0>(as_tensor(A), as_tensor(B),
@@ -281,7 +800,7 @@ auto operator-(Ta const& A, Tb const& B)
 }
 
 template<class Ta, class Tb> 
-requires tensor_ref<Ta> || tensor_ref<Tb>
+requires (tensor_ref<Ta> || tensor_ref<Tb>) && (!lazy_ref<Ta> && !lazy_ref<Tb>)
 auto operator*(Ta const& A, Tb const& B)
 {
     return broadcast<0>(as_tensor(A), as_tensor(B),
@@ -289,7 +808,7 @@ auto operator*(Ta const& A, Tb const& B)
 }
 
 template<class Ta, class Tb> 
-requires tensor_ref<Ta> || tensor_ref<Tb>
+requires (tensor_ref<Ta> || tensor_ref<Tb>) && (!lazy_ref<Ta> && !lazy_ref<Tb>)
 auto operator/(Ta const& A, Tb const& B)
 {
     return broadcast<0>(as_tensor(A), as_tensor(B),
@@ -330,95 +849,84 @@ Ta & operator/=(Ta & A, Tb const& B)
 }
 
 
+// a view writes through, so a temporary one works on the left too
+template<view_ref V, tensor_arg Tb>
+requires (!std::is_lvalue_reference_v<V>)
+V operator+=(V && A, Tb const& B) { return A += B; }
+
+template<view_ref V, tensor_arg Tb>
+requires (!std::is_lvalue_reference_v<V>)
+V operator-=(V && A, Tb const& B) { return A -= B; }
+
+template<view_ref V, tensor_arg Tb>
+requires (!std::is_lvalue_reference_v<V>)
+V operator*=(V && A, Tb const& B) { return A *= B; }
+
+template<view_ref V, tensor_arg Tb>
+requires (!std::is_lvalue_reference_v<V>)
+V operator/=(V && A, Tb const& B) { return A /= B; }
+
+
 template<class A, class B>
 using bin_op_t = decltype(std::declval<A>() * std::declval<B>());
 
 
-template<int J, int K, int dA=1, class Ta, class Tb>
-auto vec_mat_mul(Ta const* a, tensor<Tb, J, K> const& b)
+// out = a @ b for 2-d views, the strides go straight to gemm
+template<view_ref Va, view_ref Vb>
+auto mat_mul_strided(Va const& a, Vb const& b)
 {
-    tensor<bin_op_t<Ta, Tb>, K> out;
-    constexpr int TILE = 16;
-    int k0;
-    // break K into tiles for better SIMD utilization
-    for(k0=0 ; k0+TILE<=K ; k0+=TILE)
+    constexpr int I = Va::size(0);
+    constexpr int J = Va::size(1);
+    constexpr int K = Vb::size(1);
+    static_assert(Vb::size(0) == J, "mat_mul inner dim mismatch");
+
+    auto_tensor_t<bin_op_t<element_type<Va>, element_type<Vb>>, I, K> out;
+    constexpr int AI = Va::stride(0);
+
+    // big ones go to the intra-op pool in blocks of rows, each packs B for itself,
+    // so blocks are kept to at least 4 row tiles
+    constexpr int MR = simd<float>::MR;
+    constexpr int IB = std::max(4 * MR, (I / 16 + MR - 1) / MR * MR);
+    constexpr int NB = (I + IB - 1) / IB;
+    constexpr std::size_t work = std::size_t(I) * J * K;
+    if constexpr ( work >= GAII_INTRA_OP_MIN && NB >= 2 )
     {
-        for(int k=k0 ; k<k0+TILE ; k++) { out(k) = 0; }
-        for(int j=0 ; j<J ; j++)
-            for(int k=k0 ; k<k0+TILE ; k++)
-            {
-                out(k) += a[dA * j] * b(j, k).item();
-            }
-    }
-    for(int k=k0 ; k<K ; k++) { out(k) = 0; }
-    for(int j=0 ; j<J ; j++)
-        for(int k=k0 ; k<K ; k++)
+        if(intra_op_split<work, NB>(&thread_pool::gemm_threshold))
         {
-            out(k) += a[dA * j] * b(j, k).item();
+            intra_op_pool().parallel_for(NB, [&] (int n) {
+                int i0 = n * IB;
+                if(i0 + IB <= I)
+                {
+                    gemm<IB, J, K, AI, Va::stride(1), Vb::stride(0), Vb::stride(1)>(
+                        a.raw() + i0 * AI, b.raw(), out.raw() + i0 * K);
+                }
+                else if constexpr ( I % IB > 0 )
+                {
+                    gemm<I % IB, J, K, AI, Va::stride(1), Vb::stride(0), Vb::stride(1)>(
+                        a.raw() + i0 * AI, b.raw(), out.raw() + i0 * K);
+                }
+            });
+            return out;
         }
+    }
+    gemm<I, J, K, AI, Va::stride(1), Vb::stride(0), Vb::stride(1)>(
+        a.raw(), b.raw(), out.raw());
     return out;
 }
 
+// transposes are views, so B^T is read in place, and packed into row panels by gemm
 template<bool transA, bool transB>
-struct mat_mul_kernel;
-
-template<>
-struct mat_mul_kernel<false, false>
-{
-    // TODO specialize K==1
-    template<class Ta, class Tb, int I, int J, int K>
-    auto operator()(tensor<Ta, I, J> const& a, tensor<Tb, J, K> const& b)
-    {
-        tensor<bin_op_t<Ta, Tb>, I, K> out;
-        for(int i=0 ; i<I ; i++)
-        {
-            out[i] = vec_mat_mul(a[i].raw(), b);
-        }
-        return out;
-    }
-};
-
-template<>
-struct mat_mul_kernel<true, false>
-{
-    template<class Ta, class Tb, int I, int J, int K>
-    auto operator()(tensor<Ta, J, I> const& a, tensor<Tb, J, K> const& b)
-    {
-        tensor<bin_op_t<Ta, Tb>, I, K> out;
-        for(int i=0 ; i<I ; i++)
-        {
-            // out[i,0:K] = a[0:J, i] @ b[0:J, 0:K]
-            out[i] = vec_mat_mul<J, K, I>(a.raw() + i, b);
-        }
-        return out;
-    }
-};
-
-template<>
-struct mat_mul_kernel<false, true>
+struct mat_mul_kernel
 {
-    template<class Ta, class Tb, int I, int J, int K>
-    auto operator()(tensor<Ta, I, J> const& a, tensor<Tb, K, J> const& b)
+    auto operator()(auto const& a, auto const& b) const
     {
-        tensor<bin_op_t<Ta, Tb>, I, K> out;
-        // TODO optimize
-        for(int i=0 ; i<I ; i++)
-        {
-            for(int k=0 ; k<K ; k++)
-            {
-                out(i,k) = 0;
-                for(int j=0 ; j<J ; j++)
-                {
-                    out(i,k) += a(i,j) * b(k,j);
-                }
-            }
-        }
-        return out;
+        auto va = [&] { if constexpr ( transA ) { return transpose(a); } else { return view(a); } }();
+        auto vb = [&] { if constexpr ( transB ) { return transpose(b); } else { return view(b); } }();
+        return mat_mul_strided(va, vb);
     }
 };
 
 
-
 template<bool transA, bool transB, tensor_ref Ta, tensor_ref Tb>
 auto mat_mul(Ta const& a, Tb const& b)
 {
@@ -437,8 +945,8 @@ auto operator%(Ta const& a, Tb const& b)
 template<tensor_ref Ta>
 auto sum(Ta const& a)
 {
-    tensor<element_type<Ta>> out = 0;
-    broadcast<0>(out, a, [] (auto & a, auto & b) { a.item() += b; });
+    tensor<compute_t<element_type<Ta>>> out = 0;
+    broadcast<0>(out, a, [] (auto & a, auto & b) { a.item() += b.item(); });
     return out;
 }
 
@@ -451,95 +959,105 @@ auto max(Ta const& a)
     return out;
 }
 
-
-#define APPROX_MATH
-
-#ifdef APPROX_MATH
-
-float fast_exp(float a)
-{
-    // https://github.com/ekmett/approximate/blob/master/cbits/fast.c
-    union { float f; int32_t i; } p, n;
-    p.i = 1056478197 + 6051102 * a; // exp(a/2)
-    n.i = 1056478197 - 6051102 * a; // exp(-a/2)
-    return p.f / n.f;
-}
-float fast_log(float a)
-{
-    // https://github.com/ekmett/approximate/blob/master/cbits/fast.c
-    union { float f; int32_t i; } u = { a };
-    return (u.i - 1064866805) * (1.0f / 12102203);
-}
-float fast_sigmoid(float a)
-{
-    // https://github.com/ekmett/approximate/blob/master/cbits/fast.c
-    union { float f; int32_t i; } p, n;
-    p.i = 1056478197 + 6051102 * a; // exp(a/2)
-    n.i = 1056478197 - 6051102 * a; // exp(-a/2)
-    return p.f / (p.f + n.f);
-}
-float fast_tanh(float a)
+// rows of a table, by index
+template<tensor_ref Table, int B>
+auto embedding(Table const& table, tensor<int, B> const& index)
 {
-    // https://github.com/ekmett/approximate/blob/master/cbits/fast.c
-    union { float f; int32_t i; } p, n;
-    p.i = 1064866805 + 12102203 * a; // exp(a)
-    n.i = 1064866805 - 12102203 * a; // exp(-a)
-    return (p.f - n.f) / (p.f + n.f);
+    return stack<B>([&] (int b) { return table[index(b)]; });
 }
 
+
+// reduce the last dim, keeping it with size 1 so the result broadcasts back
 template<tensor_ref Ta>
-Ta exp(Ta const& A)
+auto sum_last(Ta const& a)
 {
-    return broadcast<0>(A, [] (auto & a) { return fast_exp(a); });
+    return broadcast<1>(a, [] (auto & x) { return stack<1>([&] (int) { return sum(x); }); });
 }
 
 template<tensor_ref Ta>
-Ta log(Ta const& A)
+auto max_last(Ta const& a)
 {
-    return broadcast<0>(A, [] (auto & a) { return fast_log(a); });
+    return broadcast<1>(a, [] (auto & x) { return stack<1>([&] (int) { return max(x); }); });
 }
 
-template<tensor_ref Ta>
-Ta sigmoid(Ta const& A)
+
+// what an elementwise op on Ta returns, views come back as dense tensors
+template<class Ta, class Seq = std::make_index_sequence<Ta::ndim()>>
+struct dense_result_helper { using type = Ta; };
+
+template<view_ref V, std::size_t... I>
+struct dense_result_helper<V, std::index_sequence<I...>>
 {
-    return broadcast<0>(A, [] (auto & a) { return fast_sigmoid(a); });
-}
+    using type = auto_tensor_t<element_type<V>, V::shape[I]...>;
+};
 
 template<tensor_ref Ta>
-Ta tanh(Ta const& A)
-{
-    return broadcast<0>(A, [] (auto & a) { return fast_tanh(a); });
-}
+using dense_result_t = typename dense_result_helper<std::remove_cvref_t<Ta>>::type;
+
 
-#else // not APPROX_MATH
+// whole float tensors through the simd kernels in vmath.h,
+// half ones a block at a time through float, and any other element type one
+// value at a time in its own precision, through the scalar math_ functions
+// the kernels want contiguous elements, so strided views are copied out first
 
+// true for tensors, and for views over elements laid out like one
 template<tensor_ref Ta>
-Ta exp(Ta const& A)
+constexpr bool is_contiguous()
 {
-    return broadcast<0>(A, std::exp);
+    if constexpr ( view_ref<Ta> ) { return Ta::strides == contiguous_strides(Ta::shape); }
+    else { return true; }
 }
 
-template<tensor_ref Ta>
-Ta log(Ta const& A)
+template<tensor_ref Ta, class F, class Scalar>
+dense_result_t<Ta> vmath_apply(Ta const& A, F f, Scalar scalar)
 {
-    return broadcast<0>(A, std::log);
+    using Y = dense_result_t<Ta>;
+    using E = element_type<Ta>;
+    if constexpr ( !std::is_same_v<E, float> && !half_ref<E> )
+    {
+        return broadcast<0>(A, [&] (auto & a) { return E(scalar(a.item())); });
+    }
+    else if constexpr ( !is_contiguous<Ta>() )
+    {
+        Y x = A;
+        return vmath_apply(x, f, scalar);
+    }
+    else
+    {
+        Y y;
+        if constexpr ( std::is_same_v<E, float> ) { f(A.raw(), y.raw(), Ta::size()); }
+        else
+        {
+            alignas(64) float x[256];
+            for(int i=0 ; i<Ta::size() ; i+=256)
+            {
+                int n = std::min(256, Ta::size() - i);
+                to_float(A.raw() + i, x, n);
+                f(x, x, n);
+                from_float(x, y.raw() + i, n);
+            }
+        }
+        return y;
+    }
 }
 
 template<tensor_ref Ta>
-Ta tanh(Ta const& A)
-{
-    return broadcast<0>(A, std::tanh);
-}
+dense_result_t<Ta> exp(Ta const& A) { return vmath_apply(A, vexp<>, [] (auto a) { return math_exp(a); }); }
 
 template<tensor_ref Ta>
-Ta sigmoid(Ta const& A)
-{
-    return broadcast<0>(A, [] (auto & a) {
-        return 1 / (1 + std::exp(-a.item()));
-    });
-}
+dense_result_t<Ta> log(Ta const& A) { return vmath_apply(A, vlog<>, [] (auto a) { return math_log(a); }); }
 
-#endif // APPROX_MATH
+template<tensor_ref Ta>
+dense_result_t<Ta> sigmoid(Ta const& A) { return vmath_apply(A, vsigmoid<>, [] (auto a) { return math_sigmoid(a); }); }
+
+template<tensor_ref Ta>
+dense_result_t<Ta> tanh(Ta const& A) { return vmath_apply(A, vtanh<>, [] (auto a) { return math_tanh(a); }); }
+
+template<scalar_ref T>
+T sigmoid(T a) { return math_sigmoid(a); }
+
+template<scalar_ref T>
+T tanh(T a) { return math_tanh(a); }
 
 template<tensor_ref Ta>
 Ta sqrt(Ta const& A)
@@ -21,6 +21,7 @@ struct var
     T const& get_value() const { return value; }
     T const& get_grad() const { return grad; }
     void backward(auto && grad) { this->grad += grad; }
+    void backward_row(int i, auto && grad) { this->grad[i] += grad; }
 };
 
 template<class T> var(T) -> var<T>;
@@ -82,22 +83,37 @@ void backward(T && v, auto && grad)
     v.backward(grad);
 }
 
+// gradient for row i only, so sparse users don't touch the whole tensor
+template<diffable T>
+void backward_row(T && v, int i, auto && grad)
+{
+    v.backward_row(i, grad);
+}
+
+
 
 
+// anything else is a constant, e.g. a scalar or a plain tensor in no-grad code
 
 template<class T>
-requires std::integral<T> || std::floating_point<T>
+requires (!diffable<T>)
 T const& value(T const& v)
 { 
     return v;
 }
 
 template<class T>
-requires std::integral<T> || std::floating_point<T>
+requires (!diffable<T>)
 void backward(T const&, auto &&)
 {   // no-op
 } 
 
+template<class T>
+requires (!diffable<T>)
+void backward_row(T const&, int, auto &&)
+{   // no-op
+} 
+
 
 
 } // namespace gaii
\ No newline at end of file
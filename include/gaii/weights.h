@@ -0,0 +1,287 @@
+#pragma once
+
+#include "gaii/tensor.h"
+#include "gaii/grads.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gaii {
+
+
+// trained weights on disk, laid out so the file can be used where it lies
+//
+//   save_weights("model.weights", opt);          // every param, in registration order
+//   save_weights("model.weights", opt, true);    // and the optimizer state, to resume
+//   load_weights("model.weights", opt);          // copied back into the params
+//
+//   mapped_weights file("model.weights");
+//   CharModel<mapped_weights, 256, 256, 64, B> model {file};   // no-grad, no copy
+//
+// a 64 byte header, a table of 64 byte entries, then each tensor at a 64 byte
+// aligned offset, little endian. mapped_weights stands in for an optimizer:
+// its params are read only views into a mapping of the file, bound in
+// construction order, which is the order they were registered and saved in.
+// nothing is read until a kernel touches it, so opening is one mmap
+//
+// half params are saved as their fp32 master weights
+
+enum class dtype : uint32_t { f32 = 0, bf16 = 1, fp16 = 2 };
+
+template<class E>
+constexpr dtype dtype_of()
+{
+    if constexpr ( std::is_same_v<E, float> ) { return dtype::f32; }
+    else if constexpr ( std::is_same_v<E, bf16> ) { return dtype::bf16; }
+    else
+    {
+        static_assert(std::is_same_v<E, fp16>, "no dtype for this element type");
+        return dtype::fp16;
+    }
+}
+
+struct weights_header
+{
+    static constexpr char MAGIC[8] = { 'G', 'A', 'I', 'I', 'W', 'T', 'S', 0 };
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t count;    // entries in the table
+    uint32_t params;   // the first params entries are the params
+    uint32_t states;   // optimizer tensors per param after them, 0 if not saved
+    uint64_t steps;    // optimizer steps taken
+    uint8_t reserved[32];
+};
+
+struct weights_entry
+{
+    static constexpr int MAX_DIMS = 8;
+
+    uint64_t offset;   // from the start of the file, a multiple of 64
+    uint64_t bytes;
+    dtype type;
+    uint32_t param;    // the param this is, or is optimizer state for
+    uint32_t state;    // 0 for the param, k for its k'th state tensor
+    uint32_t ndim;
+    int32_t shape[MAX_DIMS];
+};
+
+static_assert(sizeof(weights_header) == 64 && sizeof(weights_entry) == 64);
+
+constexpr uint64_t align64(uint64_t n) { return (n + 63) / 64 * 64; }
+
+
+// accepts any initializer, for params whose value comes from elsewhere
+struct ignore_init
+{
+    template<class T>
+    ignore_init(T const&) {}
+};
+
+
+// a weights file mapped read only, with its header and table checked
+struct mapped_weights
+{
+    int fd = -1;
+    char const* map = nullptr;
+    std::size_t map_size = 0;
+    weights_header const* header = nullptr;
+    weights_entry const* table = nullptr;
+    int bound = 0;              // params bound so far
+    std::string error;          // why the file or a param doesn't fit, empty if good
+    std::vector<std::vector<char>> fallback; // zeros for params that didn't bind
+
+    mapped_weights(std::string const& path)
+    {
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) { error = "can't open " + path; return; }
+        if(std::size_t(st.st_size) < sizeof(weights_header)) { error = "too short for a header"; return; }
+
+        void * p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) { error = "can't map " + path; return; }
+        map = static_cast<char const*>(p);
+        map_size = st.st_size;
+        header = reinterpret_cast<weights_header const*>(map);
+        table = reinterpret_cast<weights_entry const*>(map + sizeof(weights_header));
+        error = check();
+    }
+    mapped_weights(mapped_weights const&) = delete;
+
+    ~mapped_weights()
+    {
+        if(map) { munmap(const_cast<char *>(map), map_size); }
+        if(fd >= 0) { ::close(fd); }
+    }
+
+    bool good() const { return error.empty(); }
+
+    // params in the file no param has been bound to yet
+    int unbound() const { return good() ? header->params - bound : 0; }
+
+    std::string check() const
+    {
+        if(std::memcmp(header->magic, weights_header::MAGIC, 8) != 0) { return "not a weights file"; }
+        if(header->version != weights_header::VERSION)
+        {
+            return "weights version " + std::to_string(header->version) + ", expected "
+                + std::to_string(weights_header::VERSION);
+        }
+        if(uint64_t(header->params) * (1 + header->states) != header->count) { return "bad entry count"; }
+        if(sizeof(weights_header) + uint64_t(header->count) * sizeof(weights_entry) > map_size)
+        {
+            return "table past the end of the file";
+        }
+        for(uint32_t i=0 ; i<header->count ; i++)
+        {
+            auto & e = table[i];
+            if(e.offset % 64 || e.offset + e.bytes > map_size) { return "bad offset for entry " + std::to_string(i); }
+            if(e.ndim > weights_entry::MAX_DIMS) { return "too many dims for entry " + std::to_string(i); }
+        }
+        return {};
+    }
+
+    // why entry i can't hold shape and type, empty if it can
+    std::string mismatch(int i, dtype type, int ndim, int const* shape) const
+    {
+        auto & e = table[i];
+        std::string name = "param " + std::to_string(e.param);
+        if(e.type != type) { return name + " has another dtype"; }
+        bool same = int(e.ndim) == ndim;
+        for(int d=0 ; same && d<ndim ; d++) { same = e.shape[d] == shape[d]; }
+        if(!same) { return name + " has another shape"; }
+        return {};
+    }
+
+    // the next param's elements, in place, if it is shaped like T
+    template<tensor_ref T>
+    element_type<T> const* bind()
+    {
+        using E = element_type<T>;
+        constexpr auto shape = shape_of<T>();
+        int i = bound ++;
+        if(good() && i >= int(header->params)) { error = "more params than the file has"; }
+        if(good()) { error = mismatch(i, dtype_of<E>(), T::ndim(), shape.data()); }
+        if(good()) { return reinterpret_cast<E const*>(map + table[i].offset); }
+
+        fallback.emplace_back(sizeof(E) * T::size(), 0);
+        return reinterpret_cast<E const*>(fallback.back().data());
+    }
+
+    // a read only view of the next param in the file, for models built on it
+    // it passes as diffable so value() unwraps it, but gradients are dropped
+    template<class T>
+    struct param
+    {
+        using view_type = decltype(view_as<T>(std::declval<element_type<T> const*>()));
+
+        view_type value;
+
+        param(ignore_init, mapped_weights & file) : value(file.bind<T>()) {}
+        param(param const&) = delete;
+
+        view_type const& get_value() const { return value; }
+        void backward(auto &&) {}
+    };
+};
+
+
+// params, then optimizer state if asked, false if the file couldn't be written
+template<class Optimizer>
+bool save_weights(std::string const& path, Optimizer & opt, bool with_state = false)
+{
+    auto & slots = opt.params.slots;
+    auto state = opt.state();
+    uint32_t P = slots.size();
+    uint32_t S = with_state ? state.size() : 0;
+
+    weights_header header {};
+    std::memcpy(header.magic, weights_header::MAGIC, 8);
+    header.version = weights_header::VERSION;
+    header.count = P * (1 + S);
+    header.params = P;
+    header.states = S;
+    header.steps = opt.steps;
+
+    std::vector<weights_entry> table(header.count);
+    uint64_t at = sizeof(weights_header) + header.count * sizeof(weights_entry);
+    for(uint32_t k=0 ; k<=S ; k++)
+        for(uint32_t i=0 ; i<P ; i++)
+        {
+            auto & s = slots[i];
+            if(s.shape.size() > weights_entry::MAX_DIMS) { return false; }
+            auto & e = table[k * P + i];
+            e.offset = at;
+            e.bytes = uint64_t(s.size) * sizeof(float);
+            e.type = dtype::f32;
+            e.param = i;
+            e.state = k;
+            e.ndim = s.shape.size();
+            std::copy(s.shape.begin(), s.shape.end(), e.shape);
+            at = align64(at + e.bytes);
+        }
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(table.data()), table.size() * sizeof(weights_entry));
+    char const zeros[64] = {};
+    for(auto & e : table)
+    {
+        auto & s = slots[e.param];
+        float const* src = e.state == 0 ? s.value : state[e.state - 1]->data() + s.offset;
+        out.write(reinterpret_cast<char const*>(src), e.bytes);
+        out.write(zeros, align64(e.bytes) - e.bytes);
+    }
+    return bool(out);
+}
+
+// copies a saved file back into the params of an optimizer, and its state and
+// step count if the file has state for the same optimizer
+// returns why not if the params don't match the file, and loads nothing then
+template<class Optimizer>
+std::string load_weights(std::string const& path, Optimizer & opt)
+{
+    mapped_weights file(path);
+    if(!file.good()) { return file.error; }
+
+    auto & slots = opt.params.slots;
+    auto state = opt.state();
+    if(file.header->params != slots.size())
+    {
+        return "file has " + std::to_string(file.header->params) + " params, optimizer has "
+            + std::to_string(slots.size());
+    }
+    for(std::size_t i=0 ; i<slots.size() ; i++)
+    {
+        auto & s = slots[i];
+        std::string why = file.mismatch(i, dtype::f32, s.shape.size(), s.shape.data());
+        if(!why.empty()) { return why; }
+    }
+
+    bool with_state = file.header->states == state.size();
+    for(std::size_t i=0 ; i<slots.size() ; i++)
+    {
+        auto & s = slots[i];
+        std::memcpy(s.value, file.map + file.table[i].offset, s.size * sizeof(float));
+        s.copy.store(s.value, 0, s.size);
+        for(std::size_t k=0 ; with_state && k<state.size() ; k++)
+        {
+            auto & e = file.table[(k + 1) * slots.size() + i];
+            std::memcpy(state[k]->data() + s.offset, file.map + e.offset, s.size * sizeof(float));
+        }
+    }
+    if(with_state) { opt.steps = file.header->steps; }
+    return {};
+}
+
+
+} // namespace gaii
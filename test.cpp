@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "gaii/tensor.h"
+#include "gaii/lazy.h"
 // #include "gaii/math.h"
 
 
@@ -19,4 +20,12 @@ int main()
     y += x;
     std::cout << "x = " << x << std::endl;
     std::cout << "y = " << y << std::endl;
-}
\ No newline at end of file
+
+    // double stays double, eager and lazy
+    tensor<double, 4> d = 0.5;
+    tensor<double, 4> e = exp(d);
+    tensor<double, 4> t = tanh(lazy(d) * 2);
+    std::cout.precision(17);
+    std::cout << "exp(d) = " << e << " (" << std::exp(0.5) << ")" << std::endl;
+    std::cout << "tanh(2d) = " << t << " (" << std::tanh(1.0) << ")" << std::endl;
+}
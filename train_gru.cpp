@@ -1,139 +1,25 @@
 #include <fstream>
-#include <sstream>
-#include <iostream>
-#include <random>
 
-#include <gaii/tensor.h>
-#include <gaii/math.h>
-#include <gaii/optim.h>
+#include "train_gru.h"
 
-#include <fenv.h> 
-
-
-using gaii::tensor;
-using gaii::var;
-using gaii::op;
-
-struct RNG
-{
-    std::mt19937 rng;
-    std::uniform_real_distribution<float> dist {-0.5, 0.5};
-    operator float() { return dist(rng); }
-};
+#include <gaii/corpus.h>
+#include <gaii/profile.h>
+#include <gaii/weights.h>
 
-tensor<RNG> fill;
-
-
-template<class Optimizer, int Nin, int Nout>
-struct Linear
-{
-    template<class T>
-    using Param = typename Optimizer::template param<T>;
-
-    Optimizer & opt;
-    Param<tensor<float, Nin, Nout>> w {{fill}, opt};
-    Param<tensor<float, Nout>> b {{0}, opt};
-
-    op<var<tensor<float, 1, Nout>>> operator()(
-        var<tensor<float, 1, Nin>> & x)
-    {
-        co_yield x % w + b;
-    }
-};
-
-
-template<class Optimizer, int Nin, int Nout>
-struct GRU
-{
-    template<class T>
-    using Param = typename Optimizer::template param<T>;
-
-    Optimizer & opt;
-    Param<tensor<float, Nin, Nout>> w_x_z {{fill}, opt};
-    Param<tensor<float, Nin, Nout>> w_x_r {{fill}, opt};
-    Param<tensor<float, Nin, Nout>> w_x_h {{fill}, opt};
-    Param<tensor<float, Nout, Nout>> w_h_z {{fill}, opt};
-    Param<tensor<float, Nout, Nout>> w_h_r {{fill}, opt};
-    Param<tensor<float, Nout, Nout>> w_h_h {{fill}, opt};
-    Param<tensor<float, Nout>> b_z {{0}, opt};
-    Param<tensor<float, Nout>> b_r {{0}, opt};
-    Param<tensor<float, Nout>> b_h {{0}, opt};
-
-    op<var<tensor<float, 1, Nout>>> operator()(
-        var<tensor<float, 1, Nin>> & x, 
-        var<tensor<float, 1, Nout>> & h)
-    {
-        auto z = sigmoid(x % w_x_z + h % w_h_z + b_z);
-        auto r = sigmoid(x % w_x_r + h % w_h_r + b_r);
-        auto h2 = sigmoid(x % w_x_h + (h * r) % w_h_h + b_h);
-        auto hh = (1 - z) * h + z * h2;
-        co_yield hh;
-    }
-};
+#include <fenv.h> 
 
-template<class Optimizer, int Nin, int Nout, int Nembed>
-struct CharModel
-{
-    Optimizer & opt;
-    Linear<Optimizer, Nin, Nembed> w_in {opt};
-    GRU<Optimizer, Nembed, Nembed> rnn[2] {{opt}, {opt}};
-    Linear<Optimizer, Nembed, Nout> w_out {opt};
 
-    struct Output
-    {
-        var<tensor<float, 1, Nout>> & out;
-        var<tensor<float, 1, Nembed>> & h0;
-        var<tensor<float, 1, Nembed>> & h1;
-    };
-    op<Output> operator()(
-        var<tensor<float, 1, Nin>> & x,
-        var<tensor<float, 1, Nembed>> & h0,
-        var<tensor<float, 1, Nembed>> & h1)
-    {
-        auto x0 = w_in(x);
-        auto r0 = rnn[0](x0, h0);
-        auto x1 = x0 + r0;
-        auto r1 = rnn[1](x1, h1);
-        auto x2 = x1 + r1;
-        auto o = w_out(x2);
-        co_yield {o, r0, r1};
-    }
-};
-
-template<int Steps>
-void train_batch(char const* inputc, char const* targetc, auto & model, auto & h0, auto & h1, bool print)
+int main(int argc, char ** argv)
 {
-    static float logp_avg = -10;
-
-    if constexpr ( Steps > 0 )
+    // mapped, so the shards below are views into the file and nothing is copied
+    // the streams index the whole text at once, so it has to be a file that maps
+    gaii::corpus text("data/alice.txt");
+    if(!text.mapped())
     {
-        var<tensor<float, 1, 256>> input {0};
-        input.value(0, uint8_t(*inputc)) = 1;
-
-        var<tensor<float, 1, 256>> target {0};
-        target.value(0, uint8_t(*targetc)) = 1;
-
-        auto outs = model(input, h0, h1);
-        auto &[out, h0_next, h1_next] = *outs;
-
-        auto lm = log_softmax(out);
-        lm.backward(-target.value); // NLL loss
-        
-        float logp = value(lm)(0, uint8_t(*targetc));
-        logp_avg += (logp - logp_avg) * 0.001;
-        if(print)
-            std::cout << logp_avg << std::endl;
-
-        train_batch<Steps-1>(inputc+1, targetc+1, model, h0_next, h1_next, false);
+        std::cerr << "train_gru needs data/alice.txt as a regular file it can map" << std::endl;
+        return 1;
     }
-}
-
-
-int main(int argc, char ** argv)
-{
-    std::stringstream ss;
-    ss << std::ifstream("data/alice.txt").rdbuf();
-    std::string train = ss.str();
+    std::string_view train = text.view();
 
     std::cout << train.size() << std::endl;
 
@@ -153,19 +39,62 @@ int main(int argc, char ** argv)
     //     .beta2 = 0.999,
     // };
 
-    CharModel<decltype(opt), 256, 256, 64> model {opt};
-
-    constexpr int Nchunk = 8;
+    // steps per chunk, no recompile needed to sweep it
+    int Nchunk = argc > 1 ? std::atoi(argv[1]) : 8;
+    constexpr int Nbatch = 16;
 
-    gaii::var<tensor<float, 1, 64>> h[2] = {{0}, {0}};
+    using Model = CharModel<decltype(opt), 256, 256, 64, Nbatch>;
+    Model model {opt};
+    model.checkpointed = argc > 2 && std::string(argv[2]) == "checkpoint";
 
-    char const* trainc = train.c_str();
-    for(int offset = 0 ; offset + Nchunk < train.size() ; offset += Nchunk)
+    // data parallel workers, each on its own shard of the text
+    // and with pipeline, each runs the recurrent layers on threads of their own
+    int Nthreads = argc > 3 ? std::atoi(argv[3]) : 1;
+    bool pipelined = argc > 4 && std::string(argv[4]) == "pipeline";
+    std::string weights = argc > 5 ? argv[5] : "train_gru.weights";
+    if(Nchunk < 1 || Nthreads < 1)
+    {
+        std::cerr << "usage: train_gru [steps per chunk > 0] [checkpoint|-] [threads > 0] [pipeline|-] [weights path]" << std::endl;
+        return 1;
+    }
+    auto shard = [&] (int w) { return train.substr(train.size() * w / Nthreads, train.size() / Nthreads); };
+
+    // with -DGAII_PROFILE, keep a trace of the first steps, it grows with every op
+    gaii::profile_tracing = true;
+
+    gaii::data_parallel dp { .opt = opt, .workers = Nthreads };
+    auto run = [&] (auto & workers) {
+        int Nsteps = (workers[0].streams.length - 1) / Nchunk;
+        dp.run(Nsteps, [&] (int w, int step) {
+            if(step == 10) { gaii::profile_tracing = false; }
+            train_chunk(workers[w], step * Nchunk, model, w == 0 && step % 100 == 0);
+        });
+    };
+    if(pipelined)
     {
-        bool print = (offset / Nchunk) % 100 == 0;
+        std::deque<PipelineWorker<Model, Nbatch, 64>> workers;
+        for(int w=0 ; w<Nthreads ; w++) { workers.emplace_back(shard(w), Nchunk, model); }
+        run(workers);
+    }
+    else
+    {
+        std::deque<Worker<Model, Nbatch, 64>> workers;
+        for(int w=0 ; w<Nthreads ; w++) { workers.emplace_back(shard(w), Nchunk); }
+        run(workers);
+    }
 
-        train_batch<Nchunk>(trainc+offset, trainc+offset+1, model, h[0], h[1], print);
+#ifdef GAII_PROFILE
+    gaii::profile_report(std::cout);
+    std::ofstream trace("trace.json");
+    gaii::profile_trace(trace);
+#endif
 
-        opt.step ++;
+    // with the optimizer state, so training could pick up from here
+    if(!gaii::save_weights(weights, opt, true))
+    {
+        std::cerr << "couldn't write " << weights << std::endl;
     }
+
+    std::mt19937 rng;
+    std::cout << generate<Nbatch, 64>(model, '\n', 400, rng) << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string_view>
+
+#include <gaii/tensor.h>
+#include <gaii/math.h>
+#include <gaii/rnn.h>
+#include <gaii/bptt.h>
+#include <gaii/checkpoint.h>
+#include <gaii/optim.h>
+#include <gaii/parallel.h>
+#include <gaii/pipeline.h>
+#include <gaii/quant.h>
+#include <gaii/weights.h>
+
+
+// the char model and its training loop, shared by train_gru and bench
+
+using gaii::tensor;
+using gaii::var;
+using gaii::op;
+
+struct RNG
+{
+    std::mt19937 rng;
+    std::uniform_real_distribution<float> dist {-0.5, 0.5};
+    operator float() { return dist(rng); }
+};
+
+inline tensor<RNG> fill;
+
+
+template<class Optimizer, int Nin, int Nout, int B = 1>
+struct Linear
+{
+    template<class T>
+    using Param = typename Optimizer::template param<T>;
+
+    Optimizer & opt;
+    Param<tensor<float, Nin, Nout>> w {{fill}, opt};
+    Param<tensor<float, Nout>> b {{0}, opt};
+
+    op<var<tensor<float, B, Nout>>> operator()(
+        var<tensor<float, B, Nin>> & x)
+    {
+        co_yield x % w + b;
+    }
+
+    // no-grad, plain tensors in and out so no graph is built
+    tensor<float, B, Nout> operator()(
+        tensor<float, B, Nin> const& x)
+    {
+        return x % value(w) + value(b);
+    }
+};
+
+
+// learned row per input symbol, the sparse form of a Linear on onehot input
+template<class Optimizer, int Nin, int Nout, int B = 1>
+struct Embedding
+{
+    template<class T>
+    using Param = typename Optimizer::template param<T>;
+
+    Optimizer & opt;
+    Param<tensor<float, Nin, Nout>> w {{fill}, opt};
+
+    op<var<tensor<float, B, Nout>>> operator()(
+        tensor<int, B> const& x)
+    {
+        co_yield embedding(w, x);
+    }
+
+    // no-grad
+    tensor<float, B, Nout> lookup(
+        tensor<int, B> const& x)
+    {
+        return embedding(value(w), x);
+    }
+};
+
+
+template<class Optimizer, int Nin, int Nout, int B = 1>
+struct GRU
+{
+    template<class T>
+    using Param = typename Optimizer::template param<T>;
+
+    // gates packed as [z | r | n]
+    Optimizer & opt;
+    Param<tensor<float, Nin, 3*Nout>> w_x {{fill}, opt};
+    Param<tensor<float, Nout, 3*Nout>> w_h {{fill}, opt};
+    Param<tensor<float, 3*Nout>> b {{0}, opt};
+
+    op<var<tensor<float, B, Nout>>> operator()(
+        var<tensor<float, B, Nin>> & x, 
+        var<tensor<float, B, Nout>> & h)
+    {
+        co_yield gru_cell(x, h, w_x, w_h, b);
+    }
+
+    // T steps as one op, the input projections in a single GEMM
+    template<int T>
+    op<var<gaii::auto_tensor_t<float, T, B, Nout>>> sequence(
+        var<gaii::auto_tensor_t<float, T, B, Nin>> & xs,
+        var<tensor<float, B, Nout>> & h)
+    {
+        co_yield gru_sequence(xs, h, w_x, w_h, b);
+    }
+
+    tensor<float, B, Nout> operator()(
+        tensor<float, B, Nin> const& x,
+        tensor<float, B, Nout> const& h)
+    {
+        return gru_cell(x, h, value(w_x), value(w_h), value(b));
+    }
+};
+
+// each of the B rows is an independent stream
+template<class Optimizer, int Nin, int Nout, int Nembed, int B = 1>
+struct CharModel
+{
+    Optimizer & opt;
+    Embedding<Optimizer, Nin, Nembed, B> w_in {opt};
+    GRU<Optimizer, Nembed, Nembed, B> rnn[2] {{opt}, {opt}};
+    Linear<Optimizer, Nembed, Nout, B> w_out {opt};
+
+    // recompute the recurrent layers in backward instead of keeping their frames
+    bool checkpointed = false;
+
+    struct Output
+    {
+        var<tensor<float, B, Nout>> & out;
+        var<tensor<float, B, Nembed>> & h0;
+        var<tensor<float, B, Nembed>> & h1;
+    };
+    op<Output> operator()(
+        tensor<int, B> const& x,
+        var<tensor<float, B, Nembed>> & h0,
+        var<tensor<float, B, Nembed>> & h1)
+    {
+        auto x0 = w_in(x);
+        auto r0 = checkpointed ? checkpoint(rnn[0], x0, h0) : rnn[0](x0, h0);
+        auto x1 = x0 + r0;
+        auto r1 = checkpointed ? checkpoint(rnn[1], x1, h1) : rnn[1](x1, h1);
+        auto x2 = x1 + r1;
+        auto o = w_out(x2);
+        co_yield {o, r0, r1};
+    }
+
+    // T steps at once. layer l at step t only needs layer l-1 at t, so each
+    // recurrent layer runs over the whole chunk as one sequence op, and the
+    // embedding and output layer each take all T*B rows, t-major, in one go
+    template<int T>
+    using Seq = gaii::auto_tensor_t<float, T, B, Nembed>;
+    template<int T>
+    using Logits = gaii::auto_tensor_t<float, T*B, Nout>;
+
+    template<int T>
+    struct Chunk
+    {
+        var<Logits<T>> & out;
+        var<Seq<T>> & h0;
+        var<Seq<T>> & h1;
+    };
+    template<int T>
+    op<Chunk<T>> chunk(
+        tensor<int, T*B> x,
+        var<tensor<float, B, Nembed>> & h0,
+        var<tensor<float, B, Nembed>> & h1)
+    {
+        auto x0 = reshape<T, B, Nembed>(embedding(w_in.w, x));
+        auto r0 = rnn[0].template sequence<T>(x0, h0);
+        auto x1 = x0 + r0;
+        auto r1 = rnn[1].template sequence<T>(x1, h1);
+        auto x2 = x1 + r1;
+        auto o = reshape<T*B, Nembed>(x2) % w_out.w + w_out.b;
+        co_yield {o, r0, r1};
+    }
+
+    // one recurrent layer and its residual, the stage of a pipeline
+    static constexpr int depth = 2;
+    struct Layer
+    {
+        var<tensor<float, B, Nembed>> & out;
+        var<tensor<float, B, Nembed>> & h;
+    };
+    op<Layer> layer(int l,
+        var<tensor<float, B, Nembed>> & x,
+        var<tensor<float, B, Nembed>> & h)
+    {
+        auto r = checkpointed ? checkpoint(rnn[l], x, h) : rnn[l](x, h);
+        auto y = x + r;
+        co_yield {y, r};
+    }
+
+    struct Values
+    {
+        tensor<float, B, Nout> out;
+        tensor<float, B, Nembed> h0;
+        tensor<float, B, Nembed> h1;
+    };
+    Values operator()(
+        tensor<int, B> const& x,
+        tensor<float, B, Nembed> const& h0,
+        tensor<float, B, Nembed> const& h1)
+    {
+        auto x0 = w_in.lookup(x);
+        auto r0 = rnn[0](x0, h0);
+        tensor<float, B, Nembed> x1 = lazy(x0) + r0;
+        auto r1 = rnn[1](x1, h1);
+        tensor<float, B, Nembed> x2 = lazy(x1) + r1;
+        return {w_out(x2), r0, r1};
+    }
+};
+
+// int8 inference copies of the trained layers, no-grad only
+// weights are quantized when made, see gaii/quant.h
+
+template<int Nin, int Nout, int B = 1>
+struct QLinear
+{
+    gaii::qweights<Nin, Nout> w;
+    tensor<float, Nout> b;
+
+    QLinear(auto & linear) : w(gaii::quantize(value(linear.w))), b(value(linear.b)) {}
+
+    tensor<float, B, Nout> operator()(
+        tensor<float, B, Nin> const& x)
+    {
+        return x % w + b;
+    }
+};
+
+template<int Nin, int Nout, int B = 1>
+struct QGRU
+{
+    gaii::qweights<Nin, 3*Nout> w_x;
+    gaii::qweights<Nout, 3*Nout> w_h;
+    tensor<float, 3*Nout> b;
+
+    QGRU(auto & gru) : w_x(gaii::quantize(value(gru.w_x))), w_h(gaii::quantize(value(gru.w_h))), b(value(gru.b)) {}
+
+    tensor<float, B, Nout> operator()(
+        tensor<float, B, Nin> const& x,
+        tensor<float, B, Nout> const& h)
+    {
+        return gru_cell(x, h, w_x, w_h, b);
+    }
+};
+
+// the embedding is a row lookup, so it stays float
+template<int Nin, int Nout, int Nembed, int B = 1>
+struct QCharModel
+{
+    tensor<float, Nin, Nembed> w_in;
+    QGRU<Nembed, Nembed, B> rnn[2];
+    QLinear<Nembed, Nout, B> w_out;
+
+    QCharModel(auto & model)
+    :   w_in(value(model.w_in.w)), rnn{{model.rnn[0]}, {model.rnn[1]}}, w_out(model.w_out)
+    {}
+
+    struct Values
+    {
+        tensor<float, B, Nout> out;
+        tensor<float, B, Nembed> h0;
+        tensor<float, B, Nembed> h1;
+    };
+    Values operator()(
+        tensor<int, B> const& x,
+        tensor<float, B, Nembed> const& h0,
+        tensor<float, B, Nembed> const& h1)
+    {
+        tensor<float, B, Nembed> x0 = embedding(w_in, x);
+        auto r0 = rnn[0](x0, h0);
+        tensor<float, B, Nembed> x1 = lazy(x0) + r0;
+        auto r1 = rnn[1](x1, h1);
+        tensor<float, B, Nembed> x2 = lazy(x1) + r1;
+        return {w_out(x2), r0, r1};
+    }
+};
+
+// B streams over one text, stream b reads the b-th contiguous slice
+//
+// these are the B cursors of the batch: each starts length chars after the
+// last and all advance together, one char per step. interleaving chars
+// across streams (b, b+B, ...) would hand each row a sequence that isn't
+// text, and the recurrent state only means something over consecutive chars
+template<int B>
+struct TextStreams
+{
+    std::string_view text;
+    int length = text.size() / B;
+
+    uint8_t operator()(int b, int t) const { return text[b * length + t]; }
+};
+
+// one data parallel worker, B streams over its own shard of the text
+template<class Model, int B, int Nembed>
+struct Worker
+{
+    std::string_view shard;
+    TextStreams<B> streams {shard};
+    gaii::var<tensor<float, B, Nembed>> h[2] = {{0}, {0}};
+    gaii::bptt<op<typename Model::Output>> steps;
+    float logp_avg = -10;
+
+    Worker(std::string_view shard, int Nchunk)
+    :   shard(shard), steps(Nchunk)
+    {}
+};
+
+// a worker whose recurrent layers run as a pipeline, a thread each
+// the embedding and the output layer stay on the worker's thread
+template<class Model, int B, int Nembed>
+struct PipelineWorker
+{
+    using Hidden = var<tensor<float, B, Nembed>>;
+    using Input = decltype(std::declval<Model &>().w_in(std::declval<tensor<int, B> const&>()));
+    using Output = decltype(std::declval<Model &>().w_out(std::declval<Hidden &>()));
+
+    std::string_view shard;
+    TextStreams<B> streams {shard};
+    gaii::bptt<Input> inputs;
+    gaii::bptt<Output> outputs;
+    gaii::rnn_pipeline<op<typename Model::Layer>> pipe;
+    float logp_avg = -10;
+
+    PipelineWorker(std::string_view shard, int Nchunk, Model & model)
+    :   shard(shard), inputs(Nchunk), outputs(Nchunk),
+        pipe(Model::depth, Nchunk, [&model] (int l, Hidden & x, Hidden & h) { return model.layer(l, x, h); })
+    {}
+};
+
+// one chunk of truncated bptt, as many steps as the ring holds
+// each step feeds on the hidden state of the one before it
+template<class Model, int B, int Nembed>
+void train_steps(Worker<Model, B, Nembed> & worker, int offset, Model & model)
+{
+    auto & [shard, streams, h, steps, logp_avg] = worker;
+
+    for(int t=0 ; t<steps.capacity() ; t++)
+    {
+        tensor<int, B> input;
+        tensor<int, B> target;
+        for(int b=0 ; b<B ; b++)
+        {
+            input(b) = streams(b, offset+t);
+            target(b) = streams(b, offset+t+1);
+        }
+
+        auto & h0 = steps.empty() ? h[0] : steps.back()->h0;
+        auto & h1 = steps.empty() ? h[1] : steps.back()->h1;
+        auto & outs = steps.push(model(input, h0, h1));
+
+        auto loss = cross_entropy(outs->out, target);
+        loss.backward(1); // summed over streams
+
+        for(int b=0 ; b<B ; b++)
+        {
+            float logp = -value(loss)(b);
+            logp_avg += (logp - logp_avg) * 0.001;
+        }
+    }
+
+    // the next chunk starts where this one ends, but backward
+    // still needs the old initial state, so swap it in after
+    auto h0_last = value(steps.back()->h0);
+    auto h1_last = value(steps.back()->h1);
+    steps.backward();
+    h[0] = {h0_last};
+    h[1] = {h1_last};
+}
+
+// the same chunk as one Model::chunk<T>, for a chunk length known at compile time
+template<int T, class Model, int B, int Nembed>
+void train_sequence(Worker<Model, B, Nembed> & worker, int offset, Model & model)
+{
+    auto & [shard, streams, h, steps, logp_avg] = worker;
+
+    // rows t-major, as the chunk lays them out
+    tensor<int, T*B> input;
+    tensor<int, T*B> target;
+    for(int t=0 ; t<T ; t++)
+        for(int b=0 ; b<B ; b++)
+        {
+            input(t*B + b) = streams(b, offset+t);
+            target(t*B + b) = streams(b, offset+t+1);
+        }
+
+    tensor<float, B, Nembed> h0_last, h1_last;
+    {
+        auto outs = model.template chunk<T>(input, h[0], h[1]);
+        auto loss = cross_entropy(outs->out, target);
+        loss.backward(1);
+
+        for(int i=0 ; i<T*B ; i++)
+        {
+            float logp = -value(loss)(i);
+            logp_avg += (logp - logp_avg) * 0.001;
+        }
+        h0_last = value(outs->h0)[T-1];
+        h1_last = value(outs->h1)[T-1];
+    }
+    h[0] = {h0_last};
+    h[1] = {h1_last};
+}
+
+// chunk lengths with a compiled sequence path run as whole sequences,
+// others, and checkpointed models, step by step through the ring
+template<class Model, int B, int Nembed>
+void train_chunk(Worker<Model, B, Nembed> & worker, int offset, Model & model, bool print)
+{
+    int T = worker.steps.capacity();
+    if(model.checkpointed) { train_steps(worker, offset, model); }
+    else if(T == 8) { train_sequence<8>(worker, offset, model); }
+    else if(T == 16) { train_sequence<16>(worker, offset, model); }
+    else if(T == 32) { train_sequence<32>(worker, offset, model); }
+    else { train_steps(worker, offset, model); }
+
+    if(print)
+    {
+        auto & stats = gaii::thread_arena().stats();
+        std::cout << worker.logp_avg
+            << " frames=" << stats.frames
+            << " peak_bytes=" << stats.peak_bytes
+            << " heap_blocks=" << stats.heap_blocks << std::endl;
+    }
+}
+
+
+// the same chunk through the pipeline, which gives the same gradients
+template<class Model, int B, int Nembed>
+void train_chunk(PipelineWorker<Model, B, Nembed> & worker, int offset, Model & model, bool print)
+{
+    auto & [shard, streams, inputs, outputs, pipe, logp_avg] = worker;
+
+    pipe.forward(inputs.capacity(),
+        [&] (int t) -> auto & {
+            tensor<int, B> input;
+            for(int b=0 ; b<B ; b++) { input(b) = streams(b, offset+t); }
+            return *inputs.push(model.w_in(input));
+        },
+        [&] (int t, auto & x) {
+            tensor<int, B> target;
+            for(int b=0 ; b<B ; b++) { target(b) = streams(b, offset+t+1); }
+            auto & out = outputs.push(model.w_out(x));
+            auto loss = cross_entropy(*out, target);
+            loss.backward(1);
+            for(int b=0 ; b<B ; b++)
+            {
+                float logp = -value(loss)(b);
+                logp_avg += (logp - logp_avg) * 0.001;
+            }
+        });
+    if(print) { std::cout << logp_avg << std::endl; }
+
+    pipe.backward([&] (int) { outputs.pop(); }, [&] (int) { inputs.pop(); });
+}
+
+
+// sample B streams at once from a trained model, no graph is built
+// each(c) sees every char of the first stream as soon as it is sampled
+template<int B, int Nembed>
+std::string generate(auto & model, uint8_t seed, int length, std::mt19937 & rng, auto && each)
+{
+    tensor<float, B, Nembed> h0 = 0;
+    tensor<float, B, Nembed> h1 = 0;
+    uint8_t c[B];
+    std::fill(c, c+B, seed);
+
+    std::string out;
+    for(int t=0 ; t<length ; t++)
+    {
+        tensor<int, B> x;
+        for(int b=0 ; b<B ; b++) { x(b) = c[b]; }
+
+        auto [logits, h0_next, h1_next] = model(x, h0, h1);
+        tensor<float, B, 256> p = exp(lazy(logits) - gaii::max_last(logits));
+        h0 = h0_next;
+        h1 = h1_next;
+
+        for(int b=0 ; b<B ; b++)
+        {
+            float u = std::uniform_real_distribution<float>(0, sum(p[b]))(rng);
+            int i = 0;
+            while(i < 255 && (u -= p(b, i)) > 0) { i++; }
+            c[b] = i;
+        }
+        out += char(c[0]);
+        each(char(c[0]));
+    }
+    return out;
+}
+
+template<int B, int Nembed>
+std::string generate(auto & model, uint8_t seed, int length, std::mt19937 & rng)
+{
+    return generate<B, Nembed>(model, seed, length, rng, [] (char) {});
+}